@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "arena.h"
+#include "map.h"
+#include "player.h"
+#include "presenter.h"
+#include "renderer.h"
+#include "settings.h"
+#include "wad.h"
+
+/*
+ * Times the engine's inner kernels one at a time, on fixed inputs, and
+ * prints the results as JSON so runs can be compared kernel by kernel.
+ *
+ * Usage: kernels [-map NAME] [-filter TEXT] [-repetitions N] [-o FILE] [IWAD]
+ *
+ * Each benchmark runs as many iterations as fit in MIN_SAMPLE_SECONDS, then
+ * repeats that sample; the median, fastest and slowest sample are reported
+ * in nanoseconds per iteration. "items" is how many calls of the kernel one
+ * iteration makes, for per-call figures.
+ */
+static constexpr double MIN_SAMPLE_SECONDS = 0.02;
+static constexpr unsigned SYNTHETIC_SEED = 1993;
+
+// Results are folded in here so the work cannot be optimized away
+static volatile uint64_t sink;
+
+/*
+ * Engine access
+ */
+struct KernelBenchmarks {
+	static void BeginFrame(Renderer& renderer) { renderer.BeginFrame(); }
+	static size_t ClipHorizontal(Renderer& renderer, int startX, int endX, bool solid) { return renderer.ClipHorizontal(startX, endX, solid).size(); }
+	static Span ClipVertical(Renderer& renderer, int x, int sy, int ey, bool solid, const Sector& sector, const double* ceilingHeight, const double* floorHeight) {
+		return renderer.ClipVertical(x, sy, ey, solid, sector, ceilingHeight, floorHeight);
+	}
+	static void ClipPlane(Renderer& renderer, int x, int sy, int ey, double height, double light, const Texture* texture) {
+		renderer.ClipPlane(renderer.frame->floorPlanes, x, sy, ey, height, light, texture);
+	}
+	static void RenderWallSlice(Renderer& renderer, const WallSlice& ws) { renderer.RenderWallSlice(ws); }
+	static void RenderPlane(Renderer& renderer, const Plane& plane) { renderer.RenderPlane(plane); }
+
+	static std::vector<const WAD::Lump*> GetPatchLumps(const WAD& wad) {
+		std::vector<const WAD::Lump*> patches;
+		wad.patchLumps.ForEach([&](uint64_t, size_t index) { patches.push_back(wad.lumps[index].get()); });
+		return patches;
+	}
+	static std::shared_ptr<Texture> DecodePatch(const WAD& wad, const WAD::Lump& lump) { return wad.DecodePatch(lump); }
+};
+
+/*
+ * Measurement
+ */
+struct Result {
+	std::string name;
+	size_t iterations;
+	size_t items;
+	std::vector<double> samples;
+};
+
+class Suite {
+	std::string filter;
+	unsigned repetitions;
+	std::vector<Result> results;
+
+public:
+	Suite(const std::string& filter, unsigned repetitions): filter { filter }, repetitions { repetitions } {}
+
+	// body(iterations) runs the kernel that many times
+	void Run(const std::string& name, size_t items, const std::function<void(size_t)>& body) {
+		if (name.find(filter) == std::string::npos)
+			return;
+
+		const auto time = [&](size_t iterations) {
+			const auto start = std::chrono::steady_clock::now();
+			body(iterations);
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		};
+
+		// Warms caches, then grows the sample until it is long enough to time
+		size_t iterations = 1;
+		for (auto seconds = time(iterations); seconds < MIN_SAMPLE_SECONDS; seconds = time(iterations))
+			iterations *= seconds > 0 ? std::clamp<size_t>(MIN_SAMPLE_SECONDS / seconds * 1.2, 2, 100) : 100;
+
+		Result result { name, iterations, items, {} };
+		for (unsigned i = 0; i < repetitions; i++)
+			result.samples.push_back(time(iterations) * 1e9 / iterations);
+		std::sort(result.samples.begin(), result.samples.end());
+		std::cerr << "[INFO]: " << name << ": " << result.samples[result.samples.size() / 2] << " ns" << std::endl;
+		results.push_back(result);
+	}
+
+	void Write(std::ostream& out, const std::string& wad, const std::string& map) const {
+		const auto flags = out.flags();
+		out << std::fixed << std::setprecision(1) << "{\n"
+			<< "  \"wad\": \"" << wad << "\",\n"
+			<< "  \"map\": \"" << map << "\",\n"
+			<< "  \"repetitions\": " << repetitions << ",\n"
+			<< "  \"benchmarks\": [";
+		for (size_t i = 0; i < results.size(); i++) {
+			const auto& r = results[i];
+			out << (i == 0 ? "\n" : ",\n")
+				<< "    { \"name\": \"" << r.name << "\""
+				<< ", \"iterations\": " << r.iterations
+				<< ", \"items\": " << r.items
+				<< ", \"median_ns\": " << r.samples[r.samples.size() / 2]
+				<< ", \"min_ns\": " << r.samples.front()
+				<< ", \"max_ns\": " << r.samples.back() << " }";
+		}
+		out << "\n  ]\n}" << std::endl;
+		out.flags(flags);
+	}
+};
+
+/*
+ * Synthetic inputs
+ */
+struct HorizontalClip {
+	int startX, endX;
+	bool solid;
+};
+
+// Wall spans as a frame would submit them, from a fixed seed
+static std::vector<HorizontalClip> HorizontalPattern(const std::string& pattern) {
+	std::mt19937 random { SYNTHETIC_SEED };
+	std::vector<HorizontalClip> clips;
+	if (pattern == "sweep") {
+		// Adjacent solid walls filling the screen left to right
+		for (auto x = 0; x < settings::WIDTH;) {
+			const auto width = 4 + static_cast<int>(random() % 60);
+			clips.push_back({ x, x + width, true });
+			x += width;
+		}
+	} else if (pattern == "fragmented") {
+		// Many narrow solid walls with gaps, then portals across the gaps
+		for (auto x = 0; x < settings::WIDTH; x += 16)
+			clips.push_back({ x, x + 8, true });
+		for (auto i = 0; i < 64; i++) {
+			const auto x = static_cast<int>(random() % settings::WIDTH);
+			clips.push_back({ x, x + 32 + static_cast<int>(random() % 96), false });
+		}
+	} else {
+		// Random mix of walls and portals in any order, like a room seen through a doorway
+		for (auto i = 0; i < 256; i++) {
+			const auto x = static_cast<int>(random() % settings::WIDTH);
+			clips.push_back({ x, x + 1 + static_cast<int>(random() % 48), random() % 3 == 0 });
+		}
+	}
+	return clips;
+}
+
+static std::shared_ptr<Texture> PatternTexture(int width, int height) {
+	auto texture = std::make_shared<Texture>("BENCH", width, height);
+	for (auto i = 0; i < width * height; i++)
+		texture->storage[i] = static_cast<uint8_t>(i * 7 + i / width);
+	return texture;
+}
+
+/*
+ * Benchmarks
+ */
+static void Run(Suite& suite, WAD& wad, const std::string& mapName) {
+	Map map { wad, mapName };
+	Player player { map };
+	std::vector<uint32_t> pixels(settings::WIDTH * settings::HEIGHT);
+	Renderer renderer { wad, map, player, pixels.data() };
+	const auto startX = player.x, startY = player.y;
+
+	FrameArena arena;
+	suite.Run("Map::GetOrderedSegments", 1, [&](size_t iterations) {
+		for (size_t i = 0; i < iterations; i++) {
+			arena.Reset();
+			sink += map.GetOrderedSegments(player, &arena).size();
+		}
+	});
+
+	for (const auto pattern : { "sweep", "fragmented", "mixed" }) {
+		const auto clips = HorizontalPattern(pattern);
+		suite.Run(std::string("Renderer::ClipHorizontal/") + pattern, clips.size(), [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; i++) {
+				KernelBenchmarks::BeginFrame(renderer);
+				for (const auto& clip : clips)
+					sink += KernelBenchmarks::ClipHorizontal(renderer, clip.startX, clip.endX, clip.solid);
+			}
+		});
+	}
+
+	// Three steps of portals narrowing every column, then a closing wall,
+	// adding ceiling and floor spans at each step
+	const auto& sector = map.sectors.front();
+	const double ceilingHeight = sector.ceilingHeight, floorHeight = sector.floorHeight;
+	suite.Run("Renderer::ClipVertical", settings::WIDTH * 4, [&](size_t iterations) {
+		for (size_t i = 0; i < iterations; i++) {
+			KernelBenchmarks::BeginFrame(renderer);
+			for (auto x = 0; x < settings::WIDTH; x++) {
+				for (auto step = 1; step <= 3; step++) {
+					const auto span = KernelBenchmarks::ClipVertical(renderer, x, step * 40 + x % 16, settings::HEIGHT - step * 40 - x % 16, false, sector, &ceilingHeight, &floorHeight);
+					sink += span.e - span.s;
+				}
+				sink += KernelBenchmarks::ClipVertical(renderer, x, 170, 230, true, sector, &ceilingHeight, &floorHeight).s;
+			}
+		}
+	});
+
+	// Floor columns over a handful of distinct planes, as a room with steps would give
+	const auto flat = PatternTexture(64, 64);
+	suite.Run("Renderer::ClipPlane", settings::WIDTH, [&](size_t iterations) {
+		for (size_t i = 0; i < iterations; i++) {
+			KernelBenchmarks::BeginFrame(renderer);
+			for (auto x = 0; x < settings::WIDTH; x++)
+				KernelBenchmarks::ClipPlane(renderer, x, settings::HEIGHT / 2 + x % 40, settings::HEIGHT, -(x / 80) * 8.0, 160, flat.get());
+		}
+	});
+
+	for (const auto size : { 64, 128, 256 }) {
+		const auto texture = PatternTexture(size, 128);
+		for (const auto scale : { 0.5, 1.0, 2.0 }) {
+			std::ostringstream name;
+			name << "Renderer::RenderWallSlice/" << size << "x128/scale" << scale;
+			suite.Run(name.str(), settings::WIDTH, [&](size_t iterations) {
+				for (size_t i = 0; i < iterations; i++) {
+					for (auto x = 0; x < settings::WIDTH; x++) {
+						WallSlice ws { x, { 0, settings::HEIGHT }, static_cast<double>(x), scale, 0, 0, texture.get(), 200 };
+						KernelBenchmarks::RenderWallSlice(renderer, ws);
+					}
+				}
+				sink += pixels[0];
+			});
+		}
+	}
+
+	// The lower half of the screen as one plane, in full-width spans
+	std::pmr::monotonic_buffer_resource planeMemory;
+	Plane floor { -32.0, 160, flat.get(), settings::HEIGHT, &planeMemory };
+	Plane sky { NAN, 255, nullptr, settings::HEIGHT, &planeMemory };
+	for (auto y = settings::HEIGHT / 2 + 1; y < settings::HEIGHT; y++) {
+		floor.spans[y].push_back({ 0, settings::WIDTH });
+		sky.spans[settings::HEIGHT - 1 - y].push_back({ 0, settings::WIDTH });
+	}
+	for (const auto& [name, plane] : { std::pair { "flat", &floor }, std::pair { "sky", &sky } }) {
+		suite.Run(std::string("Renderer::RenderPlane/") + name, 1, [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; i++) {
+				KernelBenchmarks::BeginFrame(renderer);
+				KernelBenchmarks::RenderPlane(renderer, *plane);
+			}
+			sink += pixels[settings::WIDTH * (settings::HEIGHT - 1)];
+		});
+	}
+
+	// Presentation of a whole frame into a window-sized buffer
+	for (const auto scale : { 2, 3 }) {
+		std::vector<uint32_t> window(pixels.size() * scale * scale);
+		suite.Run("Upscale/x" + std::to_string(scale), 1, [&](size_t iterations) {
+			for (size_t i = 0; i < iterations; i++)
+				Upscale(pixels.data(), settings::WIDTH, settings::HEIGHT, window.data(), settings::WIDTH * scale, scale);
+			sink += window.back();
+		});
+	}
+
+	// Walking forward from the start, checked against every nearby wall
+	suite.Run("Player::Update", 1, [&](size_t iterations) {
+		player.Apply({ TicCommand::FORWARD, 0 });
+		for (size_t i = 0; i < iterations; i++) {
+			player.x = startX;
+			player.y = startY;
+			player.Update();
+		}
+		sink += static_cast<uint64_t>(player.x);
+	});
+
+	const auto patches = KernelBenchmarks::GetPatchLumps(wad);
+	suite.Run("WAD::DecodePatch", patches.size(), [&](size_t iterations) {
+		for (size_t i = 0; i < iterations; i++) {
+			for (const auto patch : patches) {
+				if (const auto decoded = KernelBenchmarks::DecodePatch(wad, *patch))
+					sink += decoded->width;
+			}
+		}
+	});
+}
+
+auto main(int argc, char* argv[]) -> int {
+	std::string filename = settings::IWAD, mapName = "E1M1", filter, output;
+	unsigned repetitions = 9;
+	for (auto i = 1; i < argc; i++) {
+		const auto arg = std::string(argv[i]);
+		if (arg == "-map" && i + 1 < argc)
+			mapName = argv[++i];
+		else if (arg == "-filter" && i + 1 < argc)
+			filter = argv[++i];
+		else if (arg == "-repetitions" && i + 1 < argc)
+			repetitions = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "-o" && i + 1 < argc)
+			output = argv[++i];
+		else
+			filename = arg;
+	}
+
+	WAD wad { filename };
+	Suite suite { filter, repetitions };
+	Run(suite, wad, mapName);
+
+	if (output.empty()) {
+		suite.Write(std::cout, filename, mapName);
+	} else {
+		std::ofstream file { output };
+		if (!file) {
+			std::cerr << "Error: could not create '" << output << "'" << std::endl;
+			return 1;
+		}
+		suite.Write(file, filename, mapName);
+	}
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+#include "allocations.h"
+#include "map.h"
+#include "settings.h"
+#include "wad.h"
+
+/*
+ * Times each stage of loading a WAD and all of its maps, without rendering.
+ *
+ * Usage: loader [-threads N] [-cache cold|warm] [IWAD ...]
+ *
+ * The texture and map caches under settings::CACHE_DIRECTORY change what
+ * each stage does: a cold open composes every texture and writes the cache
+ * file, a warm one maps it. "-cache cold" removes the caches before each
+ * WAD, "-cache warm" fills them first; without either, whatever is there is
+ * used. The state measured is printed either way.
+ */
+enum class CacheState {
+	AS_FOUND,
+	COLD,
+	WARM,
+};
+
+static void PrepareCaches(const std::string& filename, CacheState state) {
+	if (state == CacheState::COLD) {
+		std::error_code error;
+		for (const auto& entry : std::filesystem::directory_iterator(settings::CACHE_DIRECTORY, error)) {
+			const auto name = entry.path().filename().string();
+			if (entry.path().extension() == ".map" || (name.rfind("textures-", 0) == 0 && entry.path().extension() == ".cache"))
+				std::filesystem::remove(entry.path(), error);
+		}
+	} else if (state == CacheState::WARM) {
+		WAD wad { filename };
+		for (const auto& name : wad.GetMapNames())
+			Map { wad, name };
+	}
+}
+
+/*
+ * Allocation counting, taken from the tracker when it is built in
+ */
+#ifdef TRACK_ALLOCATIONS
+static size_t AllocationCount() {
+	return allocations::GetTotal().allocations;
+}
+
+static size_t AllocatedBytes() {
+	return allocations::GetTotal().bytes;
+}
+#else
+static std::atomic<size_t> allocationCount { 0 };
+static std::atomic<size_t> allocatedBytes { 0 };
+
+static size_t AllocationCount() {
+	return allocationCount.load();
+}
+
+static size_t AllocatedBytes() {
+	return allocatedBytes.load();
+}
+
+void* operator new(size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	if (auto pointer = std::malloc(size ? size : 1))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+	std::free(pointer);
+}
+#endif
+
+/*
+ * Reporting
+ */
+static long PeakResidentKiB() {
+	rusage usage {};
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+static std::string Milliseconds(double seconds) {
+	std::ostringstream stream;
+	stream << std::fixed << std::setprecision(3) << std::setw(10) << seconds * 1000 << " ms";
+	return stream.str();
+}
+
+struct Phase {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t allocations = AllocationCount();
+	size_t bytes = AllocatedBytes();
+
+	void Report(const std::string& name, double seconds = -1) const {
+		if (seconds < 0)
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "  " << std::left << std::setw(16) << name << std::right
+			<< Milliseconds(seconds)
+			<< std::setw(10) << AllocationCount() - allocations << " allocs"
+			<< std::setw(10) << (AllocatedBytes() - bytes) / 1024 << " KiB"
+			<< std::setw(10) << PeakResidentKiB() / 1024 << " MiB peak" << std::endl;
+	}
+};
+
+static void Run(const std::string& filename, unsigned threads, CacheState state) {
+	PrepareCaches(filename, state);
+	std::cout << filename << std::endl;
+
+	Phase open;
+	WAD wad { filename };
+	open.Report("open");
+	// Split of the time above; allocations are only counted for the whole phase
+	std::cout << "    directory     " << Milliseconds(wad.GetStatistics().directory) << std::endl;
+	std::cout << "    texture cache " << Milliseconds(wad.GetStatistics().textureCache)
+		<< (!settings::CACHE_TEXTURES ? "  (disabled)" : wad.GetStatistics().textureCacheHit ? "  (warm: mapped)" : "  (cold: composed and written)") << std::endl;
+
+	Phase compose;
+	wad.Preload(threads);
+	compose.Report("compose");
+	std::cout << "    patches       " << Milliseconds(wad.GetStatistics().patches) << std::endl;
+	std::cout << "    textures      " << Milliseconds(wad.GetStatistics().textures) << std::endl;
+
+	Phase maps;
+	const auto names = wad.GetMapNames();
+	for (const auto& name : names) {
+		Phase load;
+		Map map { wad, name };
+		load.Report(name);
+	}
+	maps.Report("maps (" + std::to_string(names.size()) + ")");
+}
+
+auto main(int argc, char* argv[]) -> int {
+	unsigned threads = 1;
+	auto state = CacheState::AS_FOUND;
+	std::vector<std::string> filenames;
+	for (auto i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "-threads" && i + 1 < argc) {
+			threads = std::max(1, std::atoi(argv[++i]));
+		} else if (std::string(argv[i]) == "-cache" && i + 1 < argc) {
+			const std::string value = argv[++i];
+			if (value != "cold" && value != "warm") {
+				std::cerr << "Error: -cache takes 'cold' or 'warm', not '" << value << "'" << std::endl;
+				exit(1);
+			}
+			state = value == "cold" ? CacheState::COLD : CacheState::WARM;
+		} else {
+			filenames.push_back(argv[i]);
+		}
+	}
+	if (filenames.empty())
+		filenames.push_back(settings::IWAD);
+
+	for (const auto& filename : filenames)
+		Run(filename, threads, state);
+	return 0;
+}
\ No newline at end of file
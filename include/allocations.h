@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+
+/*
+ * Allocation tracking, built in with `make TRACK_ALLOCATIONS=1`. Global
+ * operator new and delete are replaced to count allocations, bytes and peak
+ * live memory, attributed to the phase running on the allocating thread.
+ * Without the flag, everything here compiles to nothing.
+ */
+namespace allocations {
+	enum class Phase {
+		OTHER,
+		LOAD_WAD,
+		LOAD_MAP,
+		UPDATE,
+		RENDER,
+		PRESENT,
+		COUNT
+	};
+
+	struct Counters {
+		size_t allocations = 0;
+		size_t frees = 0;
+		size_t bytes = 0;
+	};
+
+#ifdef TRACK_ALLOCATIONS
+	// Attributes the calling thread's allocations to a phase while in scope
+	class Scope {
+		Phase previous;
+
+	public:
+		explicit Scope(Phase);
+		~Scope();
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+
+	Counters Get(Phase);
+	Counters GetTotal();
+	size_t GetLive();
+	size_t GetPeak();
+
+	// Closes a frame: totals what the update, render and present phases
+	// allocated since the last call, and once warmed up, exits if that is
+	// over settings::ALLOCATION_BUDGET
+	void EndFrame();
+
+	void Report(std::ostream&);
+#else
+	class Scope {
+	public:
+		explicit Scope(Phase) {}
+	};
+
+	inline void EndFrame() {}
+	inline void Report(std::ostream&) {}
+#endif
+}
\ No newline at end of file
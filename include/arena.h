@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+/*
+ * Bump allocator for memory that only lives for one frame. Deallocation
+ * does nothing, and Reset() makes everything available again at once.
+ * Blocks are kept across resets, so once the largest frame has been seen,
+ * frames no longer allocate from the system at all.
+ */
+class FrameArena : public std::pmr::memory_resource {
+	static constexpr size_t BLOCK_SIZE = 256 * 1024;
+
+	struct Block {
+		std::unique_ptr<std::byte[]> data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t block = 0;
+	size_t offset = 0;
+
+public:
+	// Everything allocated since the last reset must have been destroyed
+	void Reset() {
+		block = 0;
+		offset = 0;
+	}
+
+	size_t GetCapacity() const {
+		size_t capacity = 0;
+		for (const auto& b : blocks)
+			capacity += b.size;
+		return capacity;
+	}
+
+protected:
+	void* do_allocate(size_t bytes, size_t alignment) override {
+		for (; block < blocks.size(); block++, offset = 0) {
+			auto& b = blocks[block];
+			const auto start = (reinterpret_cast<uintptr_t>(b.data.get()) + offset + alignment - 1) & ~(alignment - 1);
+			const auto end = start + bytes;
+			if (end <= reinterpret_cast<uintptr_t>(b.data.get()) + b.size) {
+				offset = end - reinterpret_cast<uintptr_t>(b.data.get());
+				return reinterpret_cast<void*>(start);
+			}
+		}
+		const auto size = std::max(BLOCK_SIZE, bytes + alignment);
+		blocks.push_back({ std::make_unique<std::byte[]>(size), size });
+		return do_allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void*, size_t, size_t) override {
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+		return this == &other;
+	}
+};
\ No newline at end of file
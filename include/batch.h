@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "map.h"
+#include "parallel.h"
+#include "player.h"
+#include "renderer.h"
+#include "ticcommand.h"
+#include "wad.h"
+
+/*
+ * Runs many independent games in one process, for bots and automated
+ * tests. All instances share one read-only WAD and start from copies of
+ * one parsed map, and are stepped together over a pool of threads. When
+ * rendering, each instance draws into its own slice of one contiguous
+ * buffer of WIDTH * HEIGHT pixel frames.
+ */
+class Batch {
+	struct Instance {
+		Map map;
+		Player player;
+		std::unique_ptr<Renderer> renderer;
+
+		Instance(WAD&, const Map&, uint32_t*);
+	};
+
+	WAD& wad;
+	const Map start;
+	const bool render;
+	WorkerPool pool;
+	std::vector<uint32_t> frames;
+	std::vector<std::unique_ptr<Instance>> instances;
+
+public:
+	Batch(WAD&, const std::string&, size_t, bool, unsigned = std::thread::hardware_concurrency());
+
+	size_t GetSize() const { return instances.size(); }
+
+	// Runs one update of every instance with its command, then renders them all
+	void Step(const std::vector<TicCommand>&);
+	void Reset(size_t);
+
+	// See snapshot.h; a snapshot of one instance can be restored into any other
+	void SaveState(size_t, std::vector<uint8_t>&) const;
+	bool RestoreState(size_t, const std::vector<uint8_t>&);
+
+	const Player& GetPlayer(size_t i) const { return instances[i]->player; }
+	const Map& GetMap(size_t i) const { return instances[i]->map; }
+
+	// GetSize() frames in instance order, or null when not rendering
+	const uint32_t* GetFrames() const { return render ? frames.data() : nullptr; }
+	const uint32_t* GetFrame(size_t i) const { return render ? frames.data() + i * FRAME_SIZE : nullptr; }
+
+	static constexpr size_t FRAME_SIZE = settings::WIDTH * settings::HEIGHT;
+};
\ No newline at end of file
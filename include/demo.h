@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ticcommand.h"
+
+/*
+ * Demos are a small header naming the map and WAD they were recorded on,
+ * followed by one 3-byte TicCommand per update until the end of the file.
+ * Commands are buffered by the stream and flushed when recording ends, so a
+ * crash loses the tail that was still buffered; playback ignores a partial tic.
+ */
+struct DemoHeader {
+	std::string map;
+	uint64_t wadHash;
+	uint32_t updateRate;
+};
+
+class DemoRecorder {
+	std::ofstream file;
+
+public:
+	DemoRecorder(const std::string&, const DemoHeader&);
+	~DemoRecorder();
+
+	void Write(const TicCommand&);
+};
+
+class DemoPlayer {
+	DemoHeader header;
+	std::vector<TicCommand> tics;
+	size_t position = 0;
+
+public:
+	DemoPlayer(const std::string&);
+
+	const DemoHeader& GetHeader() const { return header; }
+	size_t GetLength() const { return tics.size(); }
+	bool IsFinished() const { return position >= tics.size(); }
+	TicCommand Read() { return tics[position++]; }
+};
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+/*
+ * Paces frames to a fixed rate on the monotonic clock. Waiting sleeps
+ * until shortly before the deadline and spins the rest, since sleeps can
+ * wake late by a scheduler tick. Deadlines advance by whole periods, so a
+ * late frame does not push back the ones after it.
+ *
+ * The time between frames goes into a histogram, reported as percentiles.
+ */
+class FramePacer {
+	using Clock = std::chrono::steady_clock;
+
+	// Left to spin before each deadline
+	static constexpr auto SPIN_MARGIN = std::chrono::microseconds(1000);
+	// Histogram resolution and range; longer frames go into the last bucket
+	static constexpr auto BUCKET = std::chrono::microseconds(50);
+	static constexpr size_t BUCKETS = 5000;
+
+	Clock::duration period;
+	Clock::time_point deadline;
+	Clock::time_point last;
+
+	std::array<uint32_t, BUCKETS> histogram {};
+	size_t frames = 0;
+	Clock::duration total {};
+	Clock::duration worst {};
+
+public:
+	// A rate of 0 does not wait, and only measures
+	explicit FramePacer(int);
+
+	// Ends a frame, returning once the next one is due
+	void Wait();
+	void Report(std::ostream&) const;
+};
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/*
+ * Ring of finished frames that the renderer draws into directly, shared
+ * with other processes through POSIX shared memory at /dev/shm/<name>.
+ *
+ * The mapping starts with a Header and one SlotHeader per slot, followed by
+ * the slots' pixels at Header::slotOffset, Header::slotSize bytes apart.
+ * Pixels are rows of width 32-bit 0x00RRGGBB values, top to bottom.
+ *
+ * Frame n goes to slot n % slotCount. Each slot's sequence is odd while
+ * the frame is being drawn and 2 * (n + 1) once frame n is finished, after
+ * which Header::published becomes n + 1. To read the latest frame, take
+ * published - 1, read its slot's sequence and check it is even and matches,
+ * use the pixels, then read the sequence again: if it changed, the slot was
+ * reused underneath the reader and the frame should be dropped.
+ */
+class FrameRing {
+public:
+	static constexpr uint32_t MAGIC = 0x4d524644; // "DFRM"
+	static constexpr uint32_t VERSION = 1;
+
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t slotCount;
+		uint32_t slotOffset;
+		uint64_t slotSize;
+		std::atomic<uint64_t> published;
+	};
+
+	struct SlotHeader {
+		std::atomic<uint64_t> sequence;
+	};
+
+private:
+	std::string name;
+	size_t size;
+	Header* header;
+	SlotHeader* slots;
+	uint8_t* pixels;
+
+	// An in-process reader that must see every frame, such as a capture
+	// thread, holds back the writer instead of having frames dropped
+	std::mutex mutex;
+	std::condition_variable changed;
+	bool hasReader = false;
+	bool closed = false;
+	uint64_t released = 0;
+
+public:
+	// An empty name keeps the ring private to this process
+	FrameRing(const std::string&, uint32_t, uint32_t, uint32_t);
+	FrameRing(const FrameRing&) = delete;
+	FrameRing& operator=(const FrameRing&) = delete;
+	~FrameRing();
+
+	uint32_t GetWidth() const { return header->width; }
+	uint32_t GetHeight() const { return header->height; }
+	uint32_t GetSlotCount() const { return header->slotCount; }
+	uint32_t* GetPixels(size_t slot) const { return reinterpret_cast<uint32_t*>(pixels + slot * header->slotSize); }
+
+	// Writer: claims the next frame's slot and returns its index, then publishes it
+	size_t Begin();
+	void End();
+
+	// In-process reader: waits for frame n, returning null once the ring is
+	// closed and every frame has been seen, and hands its slot back
+	void AttachReader();
+	const uint32_t* WaitForFrame(uint64_t);
+	void Release(uint64_t);
+	void Close();
+};
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framering.h"
+
+/*
+ * Writes every frame published to a FrameRing to a raw video file on a
+ * background thread: YUV4MPEG2 (4:2:0, full range) for paths ending in
+ * .y4m, and a stream of binary PPM images otherwise. The ring waits for
+ * the writer, so a slow disk slows the game down instead of losing frames.
+ */
+class FrameWriter {
+	FrameRing& ring;
+	std::ofstream file;
+	bool y4m;
+	std::vector<uint8_t> buffer;
+	std::thread thread;
+
+public:
+	FrameWriter(FrameRing&, const std::string&, int);
+	FrameWriter(const FrameWriter&) = delete;
+	FrameWriter& operator=(const FrameWriter&) = delete;
+	// Writes out the frames still in the ring first
+	~FrameWriter();
+
+private:
+	void Run();
+	void ConvertY4M(const uint32_t*);
+	void ConvertPPM(const uint32_t*);
+};
\ No newline at end of file
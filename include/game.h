@@ -1,7 +1,11 @@
 #pragma once
 
+#include <future>
+#include <memory>
 #include <SDL2/SDL.h>
+#include <string>
 
+#include "demo.h"
 #include "map.h"
 #include "player.h"
 #include "renderer.h"
@@ -9,17 +13,65 @@
 
 class Game {
 	WAD wad;
+	std::string mapName;
 	Map map;
 	Player player;
 	Renderer renderer;
 
+	// Map being loaded in the background, swapped in by Update
+	std::future<std::unique_ptr<Map>> pendingMap;
+	std::string pendingMapName;
+
+	// Input gathered from events until the next update
+	TicCommand input;
+	std::unique_ptr<DemoRecorder> demoRecorder;
+	std::unique_ptr<DemoPlayer> demoPlayer;
+
+	// What the view depends on, kept from before the last Update so frames
+	// between two updates can be rendered at a blend of both
+	struct ViewState {
+		double x, y, z, angle;
+		std::vector<std::pair<double, double>> sectorHeights;
+	};
+	ViewState previous;
+	// Scratch space for Render, kept so interpolated frames do not allocate
+	ViewState current;
+	ViewState blended;
+
+	// When the oldest mouse motion not yet on screen arrived, in performance
+	// counter ticks or 0: before it is simulated, after, and in the last frame
+	Uint64 pendingInputTime = 0;
+	Uint64 appliedInputTime = 0;
+	Uint64 shownInputTime = 0;
+
 public:
-	Game(uint32_t*);
+	Game(uint32_t*, const std::vector<std::string>& = {});
+
+	void LoadMap(const std::string&);
+	bool IsLoadingMap() const;
+
+	void RecordDemo(const std::string&);
+	void PlayDemo(const std::string&);
+	bool IsPlayingDemo() const;
+
+	// See snapshot.h
+	void SaveState(std::vector<uint8_t>&) const;
+	bool RestoreState(const std::vector<uint8_t>&);
 
 	void Update();
-	void Render();
+	void Render(double = 1.0);
+	// When the oldest input the last frame shows arrived, or 0 if none
+	Uint64 GetShownInputTime() const { return shownInputTime; }
+	// Where the next frames are drawn, such as a frame ring slot
+	void SetScreen(uint32_t* screen) { renderer.SetPixels(screen); }
 
 	void KeyPressed(SDL_KeyboardEvent&);
 	void KeyReleased(SDL_KeyboardEvent&);
 	void MouseMoved(SDL_MouseMotionEvent&);
+
+private:
+	bool IsLatchingInput() const;
+	void RestartMap(const std::string&);
+	void CaptureView(ViewState&) const;
+	void ApplyView(const ViewState&);
 };
\ No newline at end of file
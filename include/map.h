@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cmath>
 #include <SDL2/SDL.h>
 #include <iostream>
+#include <memory_resource>
+#include <unordered_map>
 
 #include "wad.h"
 
@@ -36,42 +39,50 @@ struct Vertex : Point {
 struct Sector {
 	double ceilingHeight;
 	double floorHeight;
-	std::shared_ptr<Texture> floorTexture;
-	std::shared_ptr<Texture> ceilingTexture;
+	const Texture* floorTexture;
+	const Texture* ceilingTexture;
 	double lightLevel;
+	int type;
+	int tag;
 
 	int timer;
 	bool open;
 	bool close;
 	const bool isSky;
 
-	Sector(double, double, std::shared_ptr<Texture>, std::shared_ptr<Texture>, double);
-	void Update();
+	// Heights as loaded, which snapshots are encoded against
+	const double initialCeilingHeight;
+	const double initialFloorHeight;
+
+	Sector(double, double, const Texture*, const Texture*, double, int, int);
+	bool Update();
 	void Trigger();
 };
 
 struct Side {
 	int xOffset;
 	int yOffset;
-	std::shared_ptr<Texture> upperTexture;
-	std::shared_ptr<Texture> lowerTexture;
-	std::shared_ptr<Texture> middleTexture;
-	Sector* sector;
+	const Texture* upperTexture;
+	const Texture* lowerTexture;
+	const Texture* middleTexture;
+	// Index into the map's sectors, since each copy of a map has its own
+	size_t sector;
 
-	Side(int xOffset, int yOffset, std::shared_ptr<Texture> upperTexture, std::shared_ptr<Texture> lowerTexture, std::shared_ptr<Texture> middleTexture, Sector* sector):
+	Side(int xOffset, int yOffset, const Texture* upperTexture, const Texture* lowerTexture, const Texture* middleTexture, size_t sector):
 	xOffset {xOffset}, yOffset {yOffset}, upperTexture {upperTexture}, lowerTexture {lowerTexture}, middleTexture {middleTexture}, sector {sector} {}
 };
 
 struct Wall : Line {
 	int type;
 	int flags;
+	int tag;
 	Side* frontSide;
 	Side* backSide;
 
 	bool twoSided = backSide != nullptr;
 
-	Wall(Vertex s, Vertex e, int type, int flags, Side* frontSide, Side* backSide):
-	Line {s, e}, type {type}, flags {flags}, frontSide {frontSide}, backSide {backSide} {}
+	Wall(Vertex s, Vertex e, int type, int flags, int tag, Side* frontSide, Side* backSide):
+	Line {s, e}, type {type}, flags {flags}, tag {tag}, frontSide {frontSide}, backSide {backSide} {}
 };
 
 struct Segment : Wall {
@@ -82,8 +93,14 @@ struct Segment : Wall {
 	bool isHorizontal = s.y == e.y;
 	bool isVertical = s.x == e.x;
 
+	// Orientation invariants, so the renderer only does player-relative work
+	double length = std::hypot(e.x - s.x, e.y - s.y);
+	double angle = std::atan2(e.y - s.y, e.x - s.x);
+	double normalAngle = angle + M_PI_2;
+	Point direction {std::cos(angle), std::sin(angle)};
+
 	Segment(Vertex s, Vertex e, Wall wall, bool opposite, int xOffset):
-	Wall {s, e, wall.type, wall.flags, opposite ? wall.backSide : wall.frontSide, opposite ? wall.frontSide : wall.backSide}, xOffset {xOffset} {}
+	Wall {s, e, wall.type, wall.flags, wall.tag, opposite ? wall.backSide : wall.frontSide, opposite ? wall.frontSide : wall.backSide}, xOffset {xOffset} {}
 };
 
 struct SubSector {
@@ -91,10 +108,13 @@ struct SubSector {
 };
 
 struct Node {
+	// Set on a child index that refers to a subsector rather than a node
+	static constexpr uint32_t SUBSECTOR = 0x80000000;
+
 	const double x, y;
 	const double dx, dy;
-	const int rightChild;
-	const int leftChild;
+	const uint32_t rightChild;
+	const uint32_t leftChild;
 };
 
 struct Thing {
@@ -107,11 +127,18 @@ struct Thing {
 };
 
 // Map
-struct Map {
+// Everything about a map that play does not change, shared between copies
+struct MapGeometry {
+	// Which map of which WAD stack this is, for checking saved state against
+	std::string name;
+	uint64_t wadHash = 0;
+
+	// Textures used by sides and sectors, which refer to them by raw pointer
+	std::vector<std::shared_ptr<Texture>> textures;
+
 	// Structural data
 	std::vector<Wall> walls;
 	std::vector<Side> sides;
-	std::vector<Sector> sectors;
 
 	// Binary-space partition data
 	std::vector<std::shared_ptr<Segment>> segs;
@@ -120,10 +147,48 @@ struct Map {
 
 	// Entity data
 	std::vector<Thing> things;
+};
+
+struct Map {
+	std::shared_ptr<const MapGeometry> geometry;
+
+	// Heights and doors, the only state play changes
+	std::vector<Sector> sectors;
+
+	// Tag indexes, built once after loading
+	std::unordered_map<int, std::vector<Sector*>> taggedSectors;
+	std::unordered_map<int, std::vector<const Wall*>> taggedWalls;
+
+	// Sectors with a door in motion, the only ones updated each tick
+	std::vector<Sector*> activeSectors;
 
 	Map(WAD&, const std::string&);
+	// Copies share the geometry and copy the sectors, so each one's doors
+	// move independently
+	Map(const Map&);
+	Map(Map&&) = default;
+	Map& operator=(const Map&) = delete;
+	Map& operator=(Map&&) = default;
 	void Update();
 
+	void Activate(const Wall&);
+	void Trigger(Sector&);
+	Sector& GetSector(const Side& side) { return sectors[side.sector]; }
+	const Sector& GetSector(const Side& side) const { return sectors[side.sector]; }
+	const std::vector<Sector*>& GetTaggedSectors(int) const;
+	const std::vector<const Wall*>& GetTaggedWalls(int) const;
+
 	static bool IsInFrontOf(const Player&, const Node&);
-	std::vector<std::shared_ptr<Segment>> GetOrderedSegments(const Player&) const;
+	std::pmr::vector<const Segment*> GetOrderedSegments(const Player&, std::pmr::memory_resource* = std::pmr::get_default_resource()) const;
+
+private:
+	bool builtNodes = false;
+
+	void BuildIndexes();
+	// False when the nodes do not fit the map, which then builds its own
+	static bool LoadExtendedNodes(MapGeometry&, const LumpData&, const std::vector<Vertex>&);
+
+	// Binary cache of the loaded level, see mapcache.cc
+	bool LoadCache(WAD&, const std::string&);
+	void StoreCache(const WAD&, const std::string&) const;
 };
\ No newline at end of file
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Packs an up-to-8 character lump name, uppercased, into one integer key
+inline uint64_t NameKey(const char* name, size_t length = 8) {
+	uint64_t key = 0;
+	for (size_t i = 0; i < length && i < 8 && name[i] != 0; i++)
+		key |= static_cast<uint64_t>(std::toupper(static_cast<unsigned char>(name[i]))) << (i * 8);
+	return key;
+}
+
+inline uint64_t NameKey(const std::string& name) {
+	return NameKey(name.c_str(), name.size());
+}
+
+/*
+ * Open-addressing hash table from name keys to values, with linear probing.
+ * The empty name (key 0) marks free slots and cannot be stored.
+ */
+template <typename T>
+class NameTable {
+	std::vector<uint64_t> keys;
+	std::vector<T> values;
+	size_t count = 0;
+
+	size_t Slot(uint64_t key) const {
+		return (key * 0x9e3779b97f4a7c15) >> 32 & (keys.size() - 1);
+	}
+
+	void Grow() {
+		std::vector<uint64_t> oldKeys(keys.empty() ? 16 : keys.size() * 2);
+		std::vector<T> oldValues(oldKeys.size());
+		std::swap(keys, oldKeys);
+		std::swap(values, oldValues);
+		count = 0;
+		for (size_t i = 0; i < oldKeys.size(); i++) {
+			if (oldKeys[i] != 0)
+				Insert(oldKeys[i], std::move(oldValues[i]), true);
+		}
+	}
+
+public:
+	// Adds the value, replacing an existing one only when asked to
+	bool Insert(uint64_t key, T value, bool replace = false) {
+		if (key == 0)
+			return false;
+		if ((count + 1) * 2 > keys.size())
+			Grow();
+		auto slot = Slot(key);
+		while (keys[slot] != 0 && keys[slot] != key)
+			slot = (slot + 1) & (keys.size() - 1);
+		if (keys[slot] == key && !replace)
+			return false;
+		if (keys[slot] == 0)
+			count++;
+		keys[slot] = key;
+		values[slot] = std::move(value);
+		return true;
+	}
+
+	const T* Find(uint64_t key) const {
+		if (keys.empty() || key == 0)
+			return nullptr;
+		auto slot = Slot(key);
+		while (keys[slot] != 0) {
+			if (keys[slot] == key)
+				return &values[slot];
+			slot = (slot + 1) & (keys.size() - 1);
+		}
+		return nullptr;
+	}
+
+	template <typename Function>
+	void ForEach(const Function& function) const {
+		for (size_t i = 0; i < keys.size(); i++) {
+			if (keys[i] != 0)
+				function(keys[i], values[i]);
+		}
+	}
+
+	size_t Size() const { return count; }
+};
\ No newline at end of file
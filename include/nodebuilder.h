@@ -0,0 +1,66 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "map.h"
+
+/*
+ * Builds SEGS, SSECTORS and NODES from a map's linedefs, for maps that ship
+ * without them or whose tree is poorly balanced. Partitions are chosen to
+ * minimize seg splits first and side imbalance (and so tree depth) second.
+ */
+class NodeBuilder {
+	struct Seg {
+		Point s;
+		Point e;
+		int wall;
+		bool opposite;
+		double offset;
+	};
+
+	enum class Side {
+		Right,
+		Left,
+		Split,
+	};
+
+public:
+	struct Statistics {
+		size_t segs = 0;
+		size_t splits = 0;
+		size_t subsectors = 0;
+		size_t nodes = 0;
+		int maxDepth = 0;
+		double averageDepth = 0;
+		// Leaves no partition could divide, which may render wrongly
+		size_t nonConvex = 0;
+	};
+
+private:
+	static constexpr double EPSILON = 1.0 / 1024.0;
+	static constexpr int SPLIT_COST = 8;
+	static constexpr size_t MAX_CANDIDATES = 128;
+
+	const std::vector<Wall>& walls;
+	Statistics statistics;
+	size_t leafDepthSum = 0;
+
+public:
+	NodeBuilder(const std::vector<Wall>&);
+
+	void Build(MapGeometry&);
+	const Statistics& GetStatistics() const { return statistics; }
+	void Report(std::ostream&, const std::string&) const;
+
+private:
+	uint32_t BuildNode(MapGeometry&, std::vector<Seg>&, int);
+	const Seg* FindPartition(const std::vector<Seg>&, size_t) const;
+	uint32_t BuildSubSector(MapGeometry&, const std::vector<Seg>&, int);
+
+	static double Distance(const Seg&, const Point&);
+	static Side Classify(const Seg&, const Seg&, double&, double&);
+	static bool IsConvex(const std::vector<Seg>&);
+	int Cost(const Seg&, const std::vector<Seg>&, int) const;
+};
\ No newline at end of file
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Calls function(i) for every i in [0, count), spread over up to `threads` threads
+template <typename Function>
+void ParallelFor(size_t count, unsigned threads, const Function& function) {
+	threads = std::max(1u, std::min<unsigned>(threads, count));
+	std::atomic<size_t> next { 0 };
+	const auto work = [&] {
+		for (auto i = next++; i < count; i = next++)
+			function(i);
+	};
+	std::vector<std::thread> workers;
+	for (unsigned t = 1; t < threads; t++)
+		workers.emplace_back(work);
+	work();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+/*
+ * Like ParallelFor, but keeps its threads between runs, for loops that are
+ * run many times a second. The calling thread takes part in every run.
+ */
+class WorkerPool {
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(size_t)>* job = nullptr;
+	size_t count = 0;
+	std::atomic<size_t> next { 0 };
+	unsigned generation = 0;
+	unsigned busy = 0;
+	bool stop = false;
+
+public:
+	WorkerPool(unsigned threads) {
+		for (unsigned t = 1; t < std::max(1u, threads); t++)
+			workers.emplace_back([this] { Work(); });
+	}
+
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock { mutex };
+			stop = true;
+		}
+		wake.notify_all();
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	// Calls function(i) for every i in [0, count) and waits for all of them
+	void Run(size_t count, const std::function<void(size_t)>& function) {
+		{
+			std::lock_guard<std::mutex> lock { mutex };
+			job = &function;
+			this->count = count;
+			next = 0;
+			busy = workers.size();
+			generation++;
+		}
+		wake.notify_all();
+		Drain();
+		std::unique_lock<std::mutex> lock { mutex };
+		done.wait(lock, [this] { return busy == 0; });
+	}
+
+private:
+	void Drain() {
+		for (auto i = next++; i < count; i = next++)
+			(*job)(i);
+	}
+
+	void Work() {
+		unsigned seen = 0;
+		std::unique_lock<std::mutex> lock { mutex };
+		while (true) {
+			wake.wait(lock, [&] { return stop || generation != seen; });
+			if (stop)
+				return;
+			seen = generation;
+			lock.unlock();
+			Drain();
+			lock.lock();
+			if (--busy == 0)
+				done.notify_one();
+		}
+	}
+};
\ No newline at end of file
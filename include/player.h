@@ -1,12 +1,15 @@
 #pragma once
 
+#include "arena.h"
 #include "wad.h"
 #include "map.h"
+#include "ticcommand.h"
 
 struct Player : Location {
 	double angle;
 
 	const double turnSpeed = 0.02;
+	const double mouseSpeed = 0.003;
 	const double walkSpeed = 8.0;
 	bool forward = false;
 	bool backward = false;
@@ -20,8 +23,12 @@ struct Player : Location {
 	Player(Map&);
 
 	void Respawn();
+	void Apply(const TicCommand&);
 	void Update();
 
 private:
+	// Scratch memory for collision checks, reused every update
+	FrameArena arena;
+
 	std::shared_ptr<SubSector> GetCurrentSubsector() const;
 };
\ No newline at end of file
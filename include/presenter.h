@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <SDL2/SDL.h>
+#include <thread>
+
+// Repeats every pixel scale times across and every row scale times down,
+// into rows pitch pixels apart; scales of 2 and 3 are vectorized
+void Upscale(const uint32_t*, int, int, uint32_t*, size_t, int);
+
+/*
+ * Shows frames in the window at settings::SCALE. When the window surface
+ * is 32-bit XRGB, frames are upscaled straight into it, and otherwise
+ * SDL_BlitScaled does the work.
+ *
+ * With a presentation thread, a frame is upscaled while the next one is
+ * drawn and shown when it is presented, one frame late. The caller must
+ * then leave a frame's pixels alone until the next Present() returns.
+ */
+class Presenter {
+	SDL_Window* window;
+	SDL_Surface* windowSurface;
+	bool direct;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable changed;
+	SDL_Surface* pending = nullptr;
+	bool scaled = false;
+	bool quit = false;
+
+public:
+	Presenter(SDL_Window*, bool);
+	Presenter(const Presenter&) = delete;
+	Presenter& operator=(const Presenter&) = delete;
+	~Presenter();
+
+	bool IsThreaded() const { return thread.joinable(); }
+	void Present(SDL_Surface*);
+
+private:
+	void Scale(SDL_Surface*);
+	void Run();
+};
\ No newline at end of file
@@ -3,9 +3,12 @@
 #include <deque>
 #include <list>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <SDL2/SDL.h>
 #include <vector>
 
+#include "arena.h"
 #include "map.h"
 #include "player.h"
 #include "settings.h"
@@ -86,13 +89,13 @@ struct VisibleSegment {
 struct Plane {
 	double height;
 	double light;
-	std::shared_ptr<Texture> texture;
-	std::vector<std::vector<Span>> spans;
+	const Texture* texture;
+	std::pmr::vector<std::pmr::vector<Span>> spans;
 
 	bool isSky = std::isnan(height);
 
-	Plane(double height, double light, std::shared_ptr<Texture> texture, size_t size):
-	height {height}, light {light}, texture {texture}, spans {size} {}
+	Plane(double height, double light, const Texture* texture, size_t size, std::pmr::memory_resource* resource):
+	height {height}, light {light}, texture {texture}, spans {size, resource} {}
 };
 
 struct WallSlice {
@@ -104,7 +107,7 @@ struct WallSlice {
 	int yPegging;
 	int yOffset;
 
-	std::shared_ptr<Texture> texture;
+	const Texture* texture;
 	int light;
 };
 
@@ -117,34 +120,48 @@ class Renderer {
 	Player& player;
 	uint32_t* pixels;
 
-	std::list<Span> horizontalOcclusion;
-	std::deque<Plane> ceilingPlanes;
-	std::deque<Plane> floorPlanes;
+	// Everything built up while drawing one frame comes from the arena
+	struct Frame {
+		std::pmr::list<Span> horizontalOcclusion;
+		std::pmr::deque<Plane> ceilingPlanes;
+		std::pmr::deque<Plane> floorPlanes;
+
+		Frame(std::pmr::memory_resource* resource):
+		horizontalOcclusion {resource}, ceilingPlanes {resource}, floorPlanes {resource} {}
+	};
+	FrameArena arena;
+	std::optional<Frame> frame;
 	int ceilingClip[settings::WIDTH];
 	int floorClip[settings::WIDTH];
 
 	Palette palette;
 	Lightmap lightmap;
+	std::shared_ptr<Texture> sky;
 
 public:
 	Renderer(WAD&, Map&, Player&, uint32_t*);
 
 	void Render();
+	void SetPixels(uint32_t* pixels) { this->pixels = pixels; }
 
 private:
+	// bench/kernels.cc times the steps below on their own
+	friend struct KernelBenchmarks;
+
 	// Rendering
+	void BeginFrame();
 	void RenderSegment(const Segment&);
 	void RenderSegmentSpan(const Span&, const VisibleSegment&);
 	void RenderWallSlice(const WallSlice&);
 	void RenderPlane(const Plane&);
 
 	// Clipping
-	std::vector<Span> ClipHorizontal(int, int, bool);
+	std::pmr::vector<Span> ClipHorizontal(int, int, bool);
 	Span ClipVertical(int, int, int, bool, const Sector&, const double* = nullptr, const double* = nullptr);
-	void ClipPlane(std::deque<Plane>&, int, int, int, double, double, std::shared_ptr<Texture>);
+	void ClipPlane(std::pmr::deque<Plane>&, int, int, int, double, double, const Texture*);
 
 	// Helpers
-	std::tuple<Vector, double> CalculateNormal(const Line&);
+	std::tuple<Vector, double> CalculateNormal(const Segment&);
 	double NormalizeAngle(double);
 	int ViewX(double);
 	int ViewY(double, double);
@@ -1,7 +1,34 @@
 #pragma once
 
+#include <cstddef>
+
 namespace settings {
 	static constexpr int WIDTH = 640;
 	static constexpr int HEIGHT = 400;
 	static constexpr int SCALE = 2;
+	// Upscale each frame on a thread of its own while the next is drawn,
+	// which shows frames one frame later
+	static constexpr bool PRESENT_THREAD = false;
+
+	// Simulation steps per second (vanilla uses 35), and a frame rate cap or 0 for none
+	static constexpr int UPDATE_RATE = 60;
+	static constexpr int FRAME_RATE = 0;
+	// Mouse motion that arrives before a frame is drawn turns that frame's
+	// view right away, instead of waiting for the next update
+	static constexpr bool LATE_LATCH_MOUSE = true;
+
+	// Slots in the frame ring used by -framering and -capture
+	static constexpr unsigned FRAME_RING_SLOTS = 3;
+
+	static constexpr const char* IWAD = "DOOM.WAD";
+	static constexpr const char* CACHE_DIRECTORY = "cache";
+	static constexpr bool REBUILD_NODES = false;
+	static constexpr size_t TEXTURE_CACHE_SIZE = 64 * 1024 * 1024;
+	static constexpr bool PRELOAD_TEXTURES = false;
+	static constexpr bool CACHE_TEXTURES = true;
+
+	// In TRACK_ALLOCATIONS builds, frames after the warm-up that allocate
+	// more than the budget are a fatal error; a budget below 0 only reports
+	static constexpr size_t ALLOCATION_WARMUP_FRAMES = 60;
+	static constexpr long ALLOCATION_BUDGET = 0;
 };
\ No newline at end of file
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "map.h"
+#include "player.h"
+
+/*
+ * Saves and restores everything that changes while a map is played: the
+ * player, and sectors that differ from how they were loaded. Snapshots are
+ * flat byte buffers, a few dozen bytes when no door is moving, and can be
+ * restored into the map they were taken from or any copy of it. They carry
+ * the map's name and WAD hash, and are refused by any other map.
+ */
+void SaveSnapshot(const Map&, const Player&, std::vector<uint8_t>&);
+bool RestoreSnapshot(Map&, Player&, const std::vector<uint8_t>&);
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+struct Texture;
+
+/*
+ * Least-recently-used cache of decoded textures, flats and patches, bounded
+ * by the bytes of pixel data it holds. Entries still referenced outside the
+ * cache are never evicted, so the limit bounds what is kept around unused.
+ */
+class TextureCache {
+public:
+	enum class Kind {
+		Texture,
+		Flat,
+		Patch,
+	};
+	using Loader = std::function<std::shared_ptr<Texture>()>;
+
+private:
+	struct Entry {
+		std::shared_ptr<Texture> texture;
+		size_t size;
+		std::list<std::pair<Kind, uint64_t>>::iterator position;
+	};
+
+	const size_t limit;
+	size_t size = 0;
+	std::array<std::unordered_map<uint64_t, Entry>, 3> entries;
+	std::list<std::pair<Kind, uint64_t>> order;
+	std::recursive_mutex mutex;
+
+public:
+	TextureCache(size_t limit): limit { limit } {}
+
+	std::shared_ptr<Texture> Get(Kind, uint64_t, const Loader&);
+	size_t GetSize() const { return size; }
+	size_t GetLimit() const { return limit; }
+	// What a texture counts for against the limit
+	static size_t SizeOf(const Texture&);
+
+private:
+	void Evict();
+};
\ No newline at end of file
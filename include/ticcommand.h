@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+// Player input for one simulation step
+struct TicCommand {
+	enum Button : uint8_t {
+		FORWARD = 1 << 0,
+		BACKWARD = 1 << 1,
+		STRAFE_LEFT = 1 << 2,
+		STRAFE_RIGHT = 1 << 3,
+		TURN_LEFT = 1 << 4,
+		TURN_RIGHT = 1 << 5,
+	};
+
+	uint8_t buttons = 0;
+	int16_t mouseX = 0;
+};
\ No newline at end of file
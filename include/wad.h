@@ -2,24 +2,51 @@
 
 #include <array>
 #include <cstdint>
-#include <fstream>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "nametable.h"
+#include "texturecache.h"
+
 struct Texture {
 	const std::string name;
 	const int width;
 	const int height;
-	const std::unique_ptr<uint8_t[]> pixels;
+	// Null when the pixels are borrowed from mapped memory
+	const std::unique_ptr<uint8_t[]> storage;
+	const uint8_t* const pixels;
 
 	Texture(const std::string& name, int width, int height):
-		name { name }, width { width }, height { height }, pixels { std::make_unique<uint8_t[]>(width * height)} {}
+		name { name }, width { width }, height { height }, storage { std::make_unique<uint8_t[]>(width * height) }, pixels { storage.get() } {}
+	Texture(const std::string& name, int width, int height, const uint8_t* pixels):
+		name { name }, width { width }, height { height }, pixels { pixels } {}
 
 	inline uint8_t GetPixel(int x, int y) const { return pixels[y * width + x]; }
 };
 
+// Read-only view into mapped WAD data
+struct LumpData {
+	const uint8_t* data;
+	size_t size;
+
+	template <typename T>
+	T Get(size_t offset) const {
+		T ret;
+		std::memcpy(&ret, data + offset, sizeof(T));
+		return ret;
+	}
+
+	std::string GetString(size_t offset, size_t length) const {
+		const auto chars = reinterpret_cast<const char*>(data + offset);
+		return std::string(chars, strnlen(chars, length));
+	}
+};
+
 class WAD {
 public:
 	class Lump {
@@ -40,50 +67,110 @@ public:
 	private:
 		Type StringToType(const std::string&);
 	public:
+		const size_t file;
+		const uint8_t* const data;
 		const uint32_t location;
 		const uint32_t size;
 		const std::string name;
 		const Type type;
-		Lump(const uint32_t, const uint32_t, const std::string);
+		Lump(const size_t, const uint8_t*, const uint32_t, const uint32_t, const std::string);
+	};
+
+	// Seconds spent in each loading phase, the last time it ran
+	struct Statistics {
+		double directory = 0;
+		double textureCache = 0;
+		double patches = 0;
+		double textures = 0;
+		// Whether the texture cache file was found, rather than rebuilt
+		bool textureCacheHit = false;
 	};
 
 private:
-	std::ifstream file;
+	// Mapped IWAD followed by PWADs, in load order
+	std::vector<LumpData> files;
+	const uint8_t* data;
+	size_t position = 0;
 	std::vector<std::shared_ptr<Lump>> lumps;
+	NameTable<size_t> lumpIndices;
+	uint64_t hash;
+	uint64_t contentHash;
+	mutable Statistics statistics;
+
+	// Where each flat, patch and texture is defined, loaded on first use
+	NameTable<size_t> flatLumps;
+	NameTable<size_t> patchLumps;
+	NameTable<const uint8_t*> textureDefinitions;
+	std::vector<uint64_t> patchNames;
+	mutable TextureCache cache;
 
-	std::map<std::string, std::shared_ptr<Texture>> flats;
-	std::map<std::string, std::shared_ptr<Texture>> textures;
+	// Persistent cache of composed textures and flats, see wadcache.cc
+	struct CachedTexture;
+	LumpData cacheFile { nullptr, 0 };
+	std::deque<Texture> cachedArena;
+	NameTable<Texture*> cachedTextures;
+	NameTable<Texture*> cachedFlats;
 
 public:
-	WAD(const std::string&);
+	WAD(const std::string&, const std::vector<std::string>& = {});
+	WAD(const WAD&) = delete;
 	~WAD();
 
 	std::shared_ptr<Lump> GetLump(const std::string&);
 	std::map<std::string, std::shared_ptr<Lump>> GetMapLumps(const std::string&);
+	std::vector<std::string> GetMapNames() const;
 
 	std::shared_ptr<Texture> GetFlat(const std::string&) const;
 	std::shared_ptr<Texture> GetTexture(const std::string&) const;
 
+	// FNV-1a hash of the merged lump directory, identifying the WAD stack
+	uint64_t GetHash() const { return hash; }
+	// Hash of every file's bytes, used to key derived caches
+	uint64_t GetContentHash() const { return contentHash; }
+
+	size_t GetTextureCacheSize() const { return cache.GetSize(); }
+	const Statistics& GetStatistics() const { return statistics; }
+	void Preload(unsigned);
+
+	LumpData GetLumpData(const Lump& lump) const {
+		return { lump.data, lump.size };
+	}
+
+	// Sequential reads over the mapped IWAD
 	void seek(size_t location) {
-		file.seekg(location, std::ios_base::seekdir::_S_beg);
+		position = location;
 	}
 
 	template <typename T>
 	T read() {
 		T ret;
-		file.read(reinterpret_cast<char*>(&ret), sizeof(T));
+		read(&ret, 1);
 		return ret;
 	}
 
 	template <typename T>
 	void read(T* buffer, size_t count) {
-		file.read(reinterpret_cast<char*>(buffer), count * sizeof(T));
+		std::memcpy(buffer, data + position, count * sizeof(T));
+		position += count * sizeof(T);
 	}
 
 	std::string readString(size_t length) {
-		char buffer[length + 1];
-		buffer[length] = 0;
-		file.read(buffer, length);
-		return std::string(buffer);
+		auto string = LumpData { data + position, length }.GetString(0, length);
+		position += length;
+		return string;
 	}
+
+private:
+	// bench/kernels.cc times patch decoding on its own
+	friend struct KernelBenchmarks;
+
+	void AddFile(const std::string&, const std::string&);
+	std::vector<std::pair<uint64_t, std::shared_ptr<Texture>>> ComposeAll(unsigned) const;
+	bool LoadTextureCache();
+	void StoreTextureCache(unsigned) const;
+	std::shared_ptr<Texture> GetCachedTexture(const NameTable<Texture*>&, uint64_t) const;
+	std::shared_ptr<Texture> LoadFlat(const Lump&) const;
+	std::shared_ptr<Texture> DecodePatch(const Lump&) const;
+	std::shared_ptr<Texture> ComposeTexture(const uint8_t*, const std::function<std::shared_ptr<Texture>(uint64_t)>&) const;
+	std::shared_ptr<Texture> GetPatch(uint64_t) const;
 };
\ No newline at end of file
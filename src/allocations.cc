@@ -0,0 +1,180 @@
+#include "allocations.h"
+
+#ifdef TRACK_ALLOCATIONS
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+#include "settings.h"
+
+namespace allocations {
+	static constexpr const char* PHASE_NAMES[] = { "other", "WAD::WAD", "Map::Map", "Game::Update", "Renderer::Render", "present" };
+
+	struct AtomicCounters {
+		std::atomic<size_t> allocations { 0 };
+		std::atomic<size_t> frees { 0 };
+		std::atomic<size_t> bytes { 0 };
+	};
+
+	static AtomicCounters counters[static_cast<size_t>(Phase::COUNT)];
+	static std::atomic<size_t> live { 0 };
+	static std::atomic<size_t> peak { 0 };
+	static thread_local Phase current = Phase::OTHER;
+
+	// Per-frame totals, only touched by the thread calling EndFrame()
+	static size_t frames = 0;
+	static size_t lastFrameAllocations = 0;
+	static size_t steadyFrames = 0;
+	static size_t steadyAllocations = 0;
+	static size_t worstFrameAllocations = 0;
+	static size_t worstFrame = 0;
+
+	/*
+	 * Hooks
+	 */
+	// Every block starts with its size, so frees know how much stops being
+	// live; the header is padded to keep malloc's alignment
+	static constexpr size_t HEADER_SIZE = alignof(std::max_align_t);
+
+	static void* Allocate(size_t size, size_t alignment) {
+		const auto header = std::max(HEADER_SIZE, alignment);
+		const auto base = alignment > HEADER_SIZE
+			? std::aligned_alloc(alignment, (header + size + alignment - 1) & ~(alignment - 1))
+			: std::malloc(header + size);
+		if (!base)
+			throw std::bad_alloc();
+
+		auto& c = counters[static_cast<size_t>(current)];
+		c.allocations.fetch_add(1, std::memory_order_relaxed);
+		c.bytes.fetch_add(size, std::memory_order_relaxed);
+		const auto now = live.fetch_add(size, std::memory_order_relaxed) + size;
+		auto highest = peak.load(std::memory_order_relaxed);
+		while (now > highest && !peak.compare_exchange_weak(highest, now, std::memory_order_relaxed)) {
+		}
+
+		const auto pointer = static_cast<std::byte*>(base) + header;
+		reinterpret_cast<size_t*>(pointer)[-1] = size;
+		return pointer;
+	}
+
+	static void Free(void* pointer, size_t alignment) {
+		if (!pointer)
+			return;
+		const auto size = reinterpret_cast<size_t*>(pointer)[-1];
+		counters[static_cast<size_t>(current)].frees.fetch_add(1, std::memory_order_relaxed);
+		live.fetch_sub(size, std::memory_order_relaxed);
+		std::free(static_cast<std::byte*>(pointer) - std::max(HEADER_SIZE, alignment));
+	}
+
+	/*
+	 * Phases
+	 */
+	Scope::Scope(Phase phase): previous { current } {
+		current = phase;
+	}
+
+	Scope::~Scope() {
+		current = previous;
+	}
+
+	Counters Get(Phase phase) {
+		const auto& c = counters[static_cast<size_t>(phase)];
+		return { c.allocations.load(), c.frees.load(), c.bytes.load() };
+	}
+
+	Counters GetTotal() {
+		Counters total;
+		for (size_t i = 0; i < static_cast<size_t>(Phase::COUNT); i++) {
+			const auto c = Get(static_cast<Phase>(i));
+			total.allocations += c.allocations;
+			total.frees += c.frees;
+			total.bytes += c.bytes;
+		}
+		return total;
+	}
+
+	size_t GetLive() {
+		return live.load();
+	}
+
+	size_t GetPeak() {
+		return peak.load();
+	}
+
+	/*
+	 * Frames
+	 */
+	void EndFrame() {
+		const auto total = Get(Phase::UPDATE).allocations + Get(Phase::RENDER).allocations + Get(Phase::PRESENT).allocations;
+		const auto frameAllocations = total - lastFrameAllocations;
+		lastFrameAllocations = total;
+		if (frames++ < settings::ALLOCATION_WARMUP_FRAMES)
+			return;
+
+		steadyFrames++;
+		steadyAllocations += frameAllocations;
+		if (frameAllocations > worstFrameAllocations) {
+			worstFrameAllocations = frameAllocations;
+			worstFrame = frames - 1;
+		}
+		if (settings::ALLOCATION_BUDGET >= 0 && frameAllocations > static_cast<size_t>(settings::ALLOCATION_BUDGET)) {
+			std::cerr << "Error: frame " << frames - 1 << " made " << frameAllocations
+				<< " allocations, over the budget of " << settings::ALLOCATION_BUDGET << std::endl;
+			Report(std::cerr);
+			exit(1);
+		}
+	}
+
+	void Report(std::ostream& out) {
+		const auto flags = out.flags();
+		out << "[INFO]: Allocations by phase:" << std::endl;
+		for (size_t i = 0; i < static_cast<size_t>(Phase::COUNT); i++) {
+			const auto c = Get(static_cast<Phase>(i));
+			out << "  " << std::left << std::setw(18) << PHASE_NAMES[i] << std::right
+				<< std::setw(10) << c.allocations << " allocs"
+				<< std::setw(10) << c.frees << " frees"
+				<< std::setw(10) << c.bytes / 1024 << " KiB" << std::endl;
+		}
+		out << "[INFO]: " << GetLive() / 1024 << " KiB live, " << GetPeak() / 1024 << " KiB peak" << std::endl;
+		if (steadyFrames > 0) {
+			out << "[INFO]: After " << settings::ALLOCATION_WARMUP_FRAMES << " warm-up frames: "
+				<< steadyAllocations << " allocations over " << steadyFrames << " frames, worst "
+				<< worstFrameAllocations << " (frame " << worstFrame << ")" << std::endl;
+		}
+		out.flags(flags);
+	}
+}
+
+/*
+ * Replaced global operators; the array and nothrow forms of the standard
+ * library forward to these
+ */
+void* operator new(size_t size) {
+	return allocations::Allocate(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+	return allocations::Allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept {
+	allocations::Free(pointer, 0);
+}
+
+void operator delete(void* pointer, std::align_val_t alignment) noexcept {
+	allocations::Free(pointer, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+	allocations::Free(pointer, 0);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t alignment) noexcept {
+	allocations::Free(pointer, static_cast<size_t>(alignment));
+}
+
+#endif
\ No newline at end of file
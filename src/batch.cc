@@ -0,0 +1,48 @@
+#include "batch.h"
+
+#include <iostream>
+
+#include "snapshot.h"
+
+Batch::Instance::Instance(WAD& wad, const Map& start, uint32_t* pixels): map { start }, player { map } {
+	if (pixels != nullptr)
+		renderer = std::make_unique<Renderer>(wad, map, player, pixels);
+}
+
+Batch::Batch(WAD& wad, const std::string& mapName, size_t count, bool render, unsigned threads):
+	wad { wad },
+	start { wad, mapName },
+	render { render },
+	pool { threads },
+	frames(render ? count * FRAME_SIZE : 0)
+{
+	for (size_t i = 0; i < count; i++)
+		instances.push_back(std::make_unique<Instance>(wad, start, render ? frames.data() + i * FRAME_SIZE : nullptr));
+}
+
+void Batch::Step(const std::vector<TicCommand>& commands) {
+	if (commands.size() != instances.size()) {
+		std::cerr << "Error: " << commands.size() << " commands for " << instances.size() << " instances" << std::endl;
+		exit(1);
+	}
+	pool.Run(instances.size(), [&](size_t i) {
+		auto& instance = *instances[i];
+		instance.player.Apply(commands[i]);
+		instance.map.Update();
+		instance.player.Update();
+		if (instance.renderer != nullptr)
+			instance.renderer->Render();
+	});
+}
+
+void Batch::Reset(size_t i) {
+	instances[i] = std::make_unique<Instance>(wad, start, render ? frames.data() + i * FRAME_SIZE : nullptr);
+}
+
+void Batch::SaveState(size_t i, std::vector<uint8_t>& buffer) const {
+	SaveSnapshot(instances[i]->map, instances[i]->player, buffer);
+}
+
+bool Batch::RestoreState(size_t i, const std::vector<uint8_t>& buffer) {
+	return RestoreSnapshot(instances[i]->map, instances[i]->player, buffer);
+}
\ No newline at end of file
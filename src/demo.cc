@@ -0,0 +1,85 @@
+#include "demo.h"
+
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+namespace {
+	constexpr char MAGIC[4] = { 'D', 'D', 'E', 'M' };
+	constexpr uint32_t VERSION = 1;
+	constexpr size_t HEADER_SIZE = 4 + 4 + 8 + 8 + 4;
+	constexpr size_t TIC_SIZE = 3;
+
+	template <typename T>
+	void Put(std::vector<char>& buffer, const T& value) {
+		const auto bytes = reinterpret_cast<const char*>(&value);
+		buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+	}
+
+	template <typename T>
+	T Get(const std::vector<char>& buffer, size_t offset) {
+		T value;
+		std::memcpy(&value, buffer.data() + offset, sizeof(T));
+		return value;
+	}
+}
+
+/*
+ * DemoRecorder
+ */
+DemoRecorder::DemoRecorder(const std::string& path, const DemoHeader& header): file { path, std::ios::binary } {
+	if (!file) {
+		std::cerr << "Error: could not create demo '" << path << "'" << std::endl;
+		exit(1);
+	}
+	std::vector<char> buffer(MAGIC, MAGIC + sizeof(MAGIC));
+	Put(buffer, VERSION);
+	char name[8] {};
+	std::strncpy(name, header.map.c_str(), sizeof(name));
+	buffer.insert(buffer.end(), name, name + sizeof(name));
+	Put(buffer, header.wadHash);
+	Put(buffer, header.updateRate);
+	file.write(buffer.data(), buffer.size());
+}
+
+void DemoRecorder::Write(const TicCommand& command) {
+	// A fixed buffer, so recording a tic does not allocate
+	char buffer[TIC_SIZE];
+	buffer[0] = static_cast<char>(command.buttons);
+	std::memcpy(buffer + 1, &command.mouseX, sizeof(command.mouseX));
+	// Left to the stream's buffer, flushed when recording ends
+	file.write(buffer, sizeof(buffer));
+}
+
+DemoRecorder::~DemoRecorder() {
+	file.close();
+	if (!file)
+		std::cerr << "[WARN]: Could not finish writing demo" << std::endl;
+}
+
+/*
+ * DemoPlayer
+ */
+DemoPlayer::DemoPlayer(const std::string& path) {
+	std::ifstream file { path, std::ios::binary };
+	if (!file) {
+		std::cerr << "Error: could not open demo '" << path << "'" << std::endl;
+		exit(1);
+	}
+	const std::vector<char> buffer { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+	if (buffer.size() < HEADER_SIZE || std::memcmp(buffer.data(), MAGIC, sizeof(MAGIC)) != 0 || Get<uint32_t>(buffer, 4) != VERSION) {
+		std::cerr << "Error: '" << path << "' is not a demo" << std::endl;
+		exit(1);
+	}
+	header.map = std::string(buffer.data() + 8, strnlen(buffer.data() + 8, 8));
+	header.wadHash = Get<uint64_t>(buffer, 16);
+	header.updateRate = Get<uint32_t>(buffer, 24);
+
+	// A trailing partial record is what is left of a crash while recording
+	for (size_t offset = HEADER_SIZE; offset + TIC_SIZE <= buffer.size(); offset += TIC_SIZE) {
+		tics.push_back(TicCommand {
+			Get<uint8_t>(buffer, offset),
+			Get<int16_t>(buffer, offset + 1),
+		});
+	}
+}
\ No newline at end of file
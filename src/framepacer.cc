@@ -0,0 +1,63 @@
+#include "framepacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <thread>
+
+FramePacer::FramePacer(int rate):
+period { rate > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate)) : Clock::duration::zero() },
+deadline { Clock::now() + period },
+last { Clock::now() } {}
+
+void FramePacer::Wait() {
+	auto now = Clock::now();
+	if (period > Clock::duration::zero()) {
+		if (now < deadline - SPIN_MARGIN)
+			std::this_thread::sleep_until(deadline - SPIN_MARGIN);
+		while ((now = Clock::now()) < deadline)
+			std::this_thread::yield();
+
+		// More than a whole frame behind, start over rather than rush to catch up
+		deadline += period;
+		if (deadline < now)
+			deadline = now + period;
+	}
+
+	const auto frameTime = now - last;
+	last = now;
+	histogram[std::min<size_t>(frameTime / BUCKET, BUCKETS - 1)]++;
+	frames++;
+	total += frameTime;
+	worst = std::max(worst, frameTime);
+}
+
+void FramePacer::Report(std::ostream& out) const {
+	if (frames == 0)
+		return;
+	const auto milliseconds = [](Clock::duration duration) { return std::chrono::duration<double, std::milli>(duration).count(); };
+	// Upper edge of the bucket holding the given fraction of frames
+	const auto percentile = [&](double fraction) {
+		const auto target = static_cast<size_t>(std::ceil(fraction * frames));
+		size_t count = 0;
+		for (size_t i = 0; i < BUCKETS; i++) {
+			if ((count += histogram[i]) >= target)
+				return milliseconds(std::min<Clock::duration>(BUCKET * (i + 1), worst));
+		}
+		return milliseconds(worst);
+	};
+
+	const auto flags = out.flags();
+	const auto precision = out.precision();
+	out << std::fixed << std::setprecision(2) << "[INFO]: Frame times over " << frames << " frames";
+	if (period > Clock::duration::zero())
+		out << ", targeting " << milliseconds(period) << " ms";
+	out << ": " << milliseconds(total) / frames << " ms average, "
+		<< percentile(0.5) << " ms median, "
+		<< percentile(0.9) << " ms 90th, "
+		<< percentile(0.99) << " ms 99th, "
+		<< percentile(0.999) << " ms 99.9th percentile, "
+		<< milliseconds(worst) << " ms worst" << std::endl;
+	out.flags(flags);
+	out.precision(precision);
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "framering.h"
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Slots start on their own pages, so readers can map them one at a time
+static constexpr size_t SLOT_ALIGNMENT = 4096;
+
+static size_t AlignUp(size_t value, size_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+FrameRing::FrameRing(const std::string& name, uint32_t width, uint32_t height, uint32_t slotCount): name { name } {
+	const auto slotOffset = AlignUp(sizeof(Header) + slotCount * sizeof(SlotHeader), SLOT_ALIGNMENT);
+	const auto slotSize = AlignUp(size_t { width } * height * sizeof(uint32_t), SLOT_ALIGNMENT);
+	size = slotOffset + slotSize * slotCount;
+
+	void* memory;
+	if (name.empty()) {
+		memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	} else {
+		const auto path = "/" + name;
+		const auto fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || ftruncate(fd, size) != 0) {
+			std::cerr << "Error: could not create shared memory '" << path << "'" << std::endl;
+			exit(1);
+		}
+		memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+	}
+	if (memory == MAP_FAILED) {
+		std::cerr << "Error: could not map a frame ring of " << size << " bytes" << std::endl;
+		exit(1);
+	}
+
+	// The magic goes in last, so readers never see a half-written header
+	header = new (memory) Header { 0, VERSION, width, height, slotCount, static_cast<uint32_t>(slotOffset), slotSize, { 0 } };
+	slots = reinterpret_cast<SlotHeader*>(header + 1);
+	for (uint32_t i = 0; i < slotCount; i++)
+		new (&slots[i]) SlotHeader { { 0 } };
+	pixels = static_cast<uint8_t*>(memory) + slotOffset;
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = MAGIC;
+}
+
+FrameRing::~FrameRing() {
+	munmap(header, size);
+	if (!name.empty())
+		shm_unlink(("/" + name).c_str());
+}
+
+/*
+ * Writer
+ */
+size_t FrameRing::Begin() {
+	const auto frame = header->published.load(std::memory_order_relaxed);
+	{
+		std::unique_lock lock { mutex };
+		changed.wait(lock, [&] { return !hasReader || released + header->slotCount > frame; });
+	}
+
+	// Readers that see the odd sequence know the slot is being drawn
+	const auto slot = frame % header->slotCount;
+	slots[slot].sequence.store(2 * frame + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	return slot;
+}
+
+void FrameRing::End() {
+	const auto frame = header->published.load(std::memory_order_relaxed);
+	slots[frame % header->slotCount].sequence.store(2 * (frame + 1), std::memory_order_release);
+	{
+		std::lock_guard lock { mutex };
+		header->published.store(frame + 1, std::memory_order_release);
+	}
+	changed.notify_all();
+}
+
+/*
+ * Reader
+ */
+void FrameRing::AttachReader() {
+	std::lock_guard lock { mutex };
+	hasReader = true;
+}
+
+const uint32_t* FrameRing::WaitForFrame(uint64_t frame) {
+	std::unique_lock lock { mutex };
+	changed.wait(lock, [&] { return closed || header->published.load(std::memory_order_acquire) > frame; });
+	if (header->published.load(std::memory_order_acquire) <= frame)
+		return nullptr;
+	return GetPixels(frame % header->slotCount);
+}
+
+void FrameRing::Release(uint64_t frame) {
+	{
+		std::lock_guard lock { mutex };
+		released = frame + 1;
+	}
+	changed.notify_all();
+}
+
+void FrameRing::Close() {
+	{
+		std::lock_guard lock { mutex };
+		closed = true;
+	}
+	changed.notify_all();
+}
\ No newline at end of file
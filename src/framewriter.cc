@@ -0,0 +1,95 @@
+#include "framewriter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+FrameWriter::FrameWriter(FrameRing& ring, const std::string& path, int rate): ring { ring }, file { path, std::ios::binary } {
+	if (!file) {
+		std::cerr << "Error: could not create '" << path << "'" << std::endl;
+		exit(1);
+	}
+	y4m = path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+
+	const auto width = ring.GetWidth(), height = ring.GetHeight();
+	if (y4m) {
+		file << "YUV4MPEG2 W" << width << " H" << height << " F" << rate << ":1 Ip A1:1 C420jpeg\n";
+		buffer.resize(width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2));
+	} else {
+		buffer.resize(width * height * 3);
+	}
+
+	ring.AttachReader();
+	thread = std::thread { &FrameWriter::Run, this };
+}
+
+FrameWriter::~FrameWriter() {
+	ring.Close();
+	thread.join();
+}
+
+void FrameWriter::Run() {
+	for (uint64_t frame = 0;; frame++) {
+		const auto pixels = ring.WaitForFrame(frame);
+		if (pixels == nullptr)
+			break;
+		if (y4m)
+			ConvertY4M(pixels);
+		else
+			ConvertPPM(pixels);
+		// The slot can be drawn over again as soon as it is converted
+		ring.Release(frame);
+
+		if (y4m)
+			file << "FRAME\n";
+		else
+			file << "P6\n" << ring.GetWidth() << " " << ring.GetHeight() << "\n255\n";
+		file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+	}
+	file.flush();
+	if (!file)
+		std::cerr << "[WARN]: Frame capture is incomplete, writing failed" << std::endl;
+}
+
+/*
+ * Conversion
+ */
+// BT.601 full range in 8.8 fixed point, as the C420jpeg color space expects
+void FrameWriter::ConvertY4M(const uint32_t* pixels) {
+	const int width = ring.GetWidth(), height = ring.GetHeight();
+	const auto chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+	auto luma = buffer.data();
+	auto cb = luma + width * height;
+	auto cr = cb + chromaWidth * chromaHeight;
+
+	for (auto i = 0; i < width * height; i++) {
+		const int r = (pixels[i] >> 16) & 0xff, g = (pixels[i] >> 8) & 0xff, b = pixels[i] & 0xff;
+		luma[i] = static_cast<uint8_t>((77 * r + 150 * g + 29 * b + 128) >> 8);
+	}
+
+	// Chroma from the average of each 2x2 block
+	for (auto y = 0; y < chromaHeight; y++) {
+		for (auto x = 0; x < chromaWidth; x++) {
+			int r = 0, g = 0, b = 0;
+			for (auto dy = 0; dy < 2; dy++) {
+				for (auto dx = 0; dx < 2; dx++) {
+					const auto pixel = pixels[std::min(2 * y + dy, height - 1) * width + std::min(2 * x + dx, width - 1)];
+					r += (pixel >> 16) & 0xff;
+					g += (pixel >> 8) & 0xff;
+					b += pixel & 0xff;
+				}
+			}
+			cb[y * chromaWidth + x] = static_cast<uint8_t>(std::clamp(((-43 * r - 85 * g + 128 * b + 512) >> 10) + 128, 0, 255));
+			cr[y * chromaWidth + x] = static_cast<uint8_t>(std::clamp(((128 * r - 107 * g - 21 * b + 512) >> 10) + 128, 0, 255));
+		}
+	}
+}
+
+void FrameWriter::ConvertPPM(const uint32_t* pixels) {
+	const auto count = ring.GetWidth() * ring.GetHeight();
+	for (size_t i = 0; i < count; i++) {
+		buffer[i * 3] = (pixels[i] >> 16) & 0xff;
+		buffer[i * 3 + 1] = (pixels[i] >> 8) & 0xff;
+		buffer[i * 3 + 2] = pixels[i] & 0xff;
+	}
+}
\ No newline at end of file
@@ -1,51 +1,204 @@
 #include "game.h"
 
-Game::Game(uint32_t* screen):
-wad { "DOOM.WAD" },
-map { wad, "E1M1" },
+#include <algorithm>
+#include <iostream>
+
+#include "allocations.h"
+#include "snapshot.h"
+
+static uint8_t KeyToButton(SDL_Keycode key) {
+	switch (key) {
+		case SDLK_w: return TicCommand::FORWARD;
+		case SDLK_a: return TicCommand::STRAFE_LEFT;
+		case SDLK_s: return TicCommand::BACKWARD;
+		case SDLK_d: return TicCommand::STRAFE_RIGHT;
+		case SDLK_LEFT: return TicCommand::TURN_LEFT;
+		case SDLK_RIGHT: return TicCommand::TURN_RIGHT;
+		default:
+			return 0;
+	}
+}
+
+Game::Game(uint32_t* screen, const std::vector<std::string>& patchFiles):
+wad { settings::IWAD, patchFiles },
+mapName { "E1M1" },
+map { wad, mapName },
 player { map },
 renderer { wad, map, player, screen } {
+	CaptureView(previous);
+}
+
+void Game::LoadMap(const std::string& name) {
+	// Only one map can be pending; the WAD itself is read-only mapped memory
+	if (IsLoadingMap())
+		return;
+	pendingMapName = name;
+	pendingMap = std::async(std::launch::async, [this, name] {
+		return std::make_unique<Map>(wad, name);
+	});
+}
+
+bool Game::IsLoadingMap() const {
+	return pendingMap.valid();
+}
+
+// Demos start from a fresh copy of the map, so recording and playback begin in the same state
+void Game::RecordDemo(const std::string& path) {
+	RestartMap(mapName);
+	demoRecorder = std::make_unique<DemoRecorder>(path, DemoHeader { mapName, wad.GetHash(), settings::UPDATE_RATE });
+}
+
+void Game::PlayDemo(const std::string& path) {
+	demoPlayer = std::make_unique<DemoPlayer>(path);
+	const auto& header = demoPlayer->GetHeader();
+	if (header.wadHash != wad.GetHash())
+		std::cerr << "[WARN]: Demo '" << path << "' was recorded with different WADs" << std::endl;
+	if (header.updateRate != settings::UPDATE_RATE)
+		std::cerr << "[WARN]: Demo '" << path << "' was recorded at " << header.updateRate << " updates per second" << std::endl;
+	RestartMap(header.map);
+}
+
+bool Game::IsPlayingDemo() const {
+	return demoPlayer != nullptr && !demoPlayer->IsFinished();
+}
+
+void Game::SaveState(std::vector<uint8_t>& buffer) const {
+	SaveSnapshot(map, player, buffer);
+}
+
+bool Game::RestoreState(const std::vector<uint8_t>& buffer) {
+	if (!RestoreSnapshot(map, player, buffer))
+		return false;
+	// Do not interpolate across the jump
+	CaptureView(previous);
+	return true;
+}
+
+void Game::RestartMap(const std::string& name) {
+	// A load still in flight would be swapped in over the restarted map by
+	// the next update, so it is waited for and dropped
+	if (pendingMap.valid()) {
+		pendingMap.wait();
+		pendingMap = {};
+	}
+	map = Map { wad, name };
+	mapName = name;
+	player.Respawn();
+	CaptureView(previous);
 }
 
 void Game::Update() {
+	allocations::Scope scope { allocations::Phase::UPDATE };
+	if (pendingMap.valid() && pendingMap.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		// Moving the vectors keeps element addresses, so references held
+		// by the player and renderer stay valid across the swap
+		map = std::move(*pendingMap.get());
+		mapName = pendingMapName;
+		player.Respawn();
+	}
+
+	CaptureView(previous);
+
+	// Input comes from the demo being played, if any, and goes to the one being recorded
+	auto command = input;
+	input.mouseX = 0;
+	if (IsPlayingDemo())
+		command = demoPlayer->Read();
+	if (demoRecorder != nullptr)
+		demoRecorder->Write(command);
+	player.Apply(command);
+	if (pendingInputTime != 0 && appliedInputTime == 0)
+		appliedInputTime = pendingInputTime;
+	pendingInputTime = 0;
+	// Mouse turns were already shown whole by late latching, so they are
+	// left out of the interpolation towards this update
+	if (IsLatchingInput())
+		previous.angle -= command.mouseX * player.mouseSpeed;
+
 	map.Update();
 	player.Update();
 }
 
-void Game::Render() {
+// Alpha is how far real time has moved from the previous update towards the last one
+void Game::Render(double alpha) {
+	// Mouse motion the simulation has not seen yet turns this frame only
+	const auto latched = IsLatchingInput() ? -input.mouseX * player.mouseSpeed : 0.0;
+	// This frame shows what updates applied since the last one, and when
+	// latching, what is still pending too, which is always the newer
+	shownInputTime = appliedInputTime;
+	appliedInputTime = 0;
+	if (IsLatchingInput() && pendingInputTime != 0) {
+		if (shownInputTime == 0)
+			shownInputTime = pendingInputTime;
+		pendingInputTime = 0;
+	}
+
+	const auto wrap = [](double angle) {
+		angle = std::fmod(angle, 2 * M_PI);
+		return angle < 0 ? angle + 2 * M_PI : angle;
+	};
+	if (alpha >= 1.0 || previous.sectorHeights.size() != map.sectors.size()) {
+		const auto angle = player.angle;
+		player.angle = wrap(angle + latched);
+		renderer.Render();
+		player.angle = angle;
+		return;
+	}
+
+	CaptureView(current);
+	const auto blend = [&](double from, double to) { return from + (to - from) * alpha; };
+	blended.x = blend(previous.x, current.x);
+	blended.y = blend(previous.y, current.y);
+	blended.z = blend(previous.z, current.z);
+	// Turn the short way round when the angle wraps
+	auto turn = std::remainder(current.angle - previous.angle, 2 * M_PI);
+	blended.angle = wrap(previous.angle + turn * alpha + latched);
+	blended.sectorHeights.resize(current.sectorHeights.size());
+	for (size_t i = 0; i < blended.sectorHeights.size(); i++) {
+		blended.sectorHeights[i].first = blend(previous.sectorHeights[i].first, current.sectorHeights[i].first);
+		blended.sectorHeights[i].second = blend(previous.sectorHeights[i].second, current.sectorHeights[i].second);
+	}
+
+	ApplyView(blended);
 	renderer.Render();
+	ApplyView(current);
 }
 
-void Game::KeyPressed(SDL_KeyboardEvent& e) {
-	switch (e.keysym.sym) {
-		case SDLK_w: player.forward = true; break;
-		case SDLK_a: player.strafeLeft = true; break;
-		case SDLK_s: player.backward = true; break;
-		case SDLK_d: player.strafeRight = true; break;
-		case SDLK_LEFT: player.turnLeft = true; break;
-		case SDLK_RIGHT: player.turnRight = true; break;
-		default:
-			break;
+bool Game::IsLatchingInput() const {
+	return settings::LATE_LATCH_MOUSE && !IsPlayingDemo();
+}
+
+void Game::CaptureView(ViewState& view) const {
+	view.x = player.x;
+	view.y = player.y;
+	view.z = player.z;
+	view.angle = player.angle;
+	view.sectorHeights.resize(map.sectors.size());
+	for (size_t i = 0; i < map.sectors.size(); i++)
+		view.sectorHeights[i] = { map.sectors[i].floorHeight, map.sectors[i].ceilingHeight };
+}
+
+void Game::ApplyView(const ViewState& view) {
+	player.x = view.x;
+	player.y = view.y;
+	player.z = view.z;
+	player.angle = view.angle;
+	for (size_t i = 0; i < view.sectorHeights.size(); i++) {
+		map.sectors[i].floorHeight = view.sectorHeights[i].first;
+		map.sectors[i].ceilingHeight = view.sectorHeights[i].second;
 	}
 }
 
+void Game::KeyPressed(SDL_KeyboardEvent& e) {
+	input.buttons |= KeyToButton(e.keysym.sym);
+}
+
 void Game::KeyReleased(SDL_KeyboardEvent& e) {
-	switch (e.keysym.sym) {
-		case SDLK_w: player.forward = false; break;
-		case SDLK_a: player.strafeLeft = false; break;
-		case SDLK_s: player.backward = false; break;
-		case SDLK_d: player.strafeRight = false; break;
-		case SDLK_LEFT: player.turnLeft = false; break;
-		case SDLK_RIGHT: player.turnRight = false; break;
-		default:
-			break;
-	}
+	input.buttons &= ~KeyToButton(e.keysym.sym);
 }
 
 void Game::MouseMoved(SDL_MouseMotionEvent& e) {
-	player.angle -= e.xrel * 0.003;
-	if (player.angle < 0)
-		player.angle += 2 * M_PI;
-	if (player.angle >= 2 * M_PI)
-		player.angle -= 2 * M_PI;
+	input.mouseX = std::clamp(input.mouseX + e.xrel, INT16_MIN, INT16_MAX);
+	if (pendingInputTime == 0 && !IsPlayingDemo())
+		pendingInputTime = SDL_GetPerformanceCounter();
 }
\ No newline at end of file
@@ -1,41 +1,186 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <numeric>
 #include <queue>
+#include <string>
+#include <vector>
 #include <SDL2/SDL.h>
 
+#include "allocations.h"
+#include "framepacer.h"
+#include "framering.h"
+#include "framewriter.h"
 #include "game.h"
 #include "map.h"
 #include "player.h"
+#include "presenter.h"
 #include "renderer.h"
 
-static constexpr auto MS_PER_UPDATE = 1000 / 60;
+// Updates run per frame at most, so a slow frame cannot snowball
+static constexpr Uint64 MAX_UPDATES_PER_FRAME = 8;
 
-auto main() -> int {
-	// Initialize SDL
-	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+// Slowest frames listed after a timedemo
+static constexpr size_t WORST_FRAMES = 5;
+
+static void ReportTimedemo(const std::vector<Uint64>& frameTimes, Uint64 frequency) {
+	if (frameTimes.empty())
+		return;
+	const auto milliseconds = [&](Uint64 ticks) { return ticks * 1000.0 / frequency; };
+	const auto total = std::accumulate(frameTimes.begin(), frameTimes.end(), Uint64 { 0 });
+	std::cout << std::fixed << std::setprecision(2)
+		<< "[INFO]: Timedemo: " << frameTimes.size() << " frames in " << milliseconds(total) / 1000.0 << " s, "
+		<< frameTimes.size() * 1000.0 / milliseconds(total) << " fps average" << std::endl;
+
+	std::vector<size_t> order(frameTimes.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return frameTimes[a] > frameTimes[b]; });
+	std::cout << "[INFO]: Worst frames:";
+	for (size_t i = 0; i < std::min(WORST_FRAMES, order.size()); i++)
+		std::cout << " " << milliseconds(frameTimes[order[i]]) << " ms (frame " << order[i] << ")";
+	std::cout << ", 99th percentile " << milliseconds(frameTimes[order[order.size() / 100]]) << " ms" << std::endl;
+}
+
+// Time from the application seeing mouse motion to the frame showing it
+// being presented, kept in a histogram so a long session does not grow it.
+// Latencies past the last bucket are counted there
+struct InputLatencies {
+	static constexpr double BUCKET_MS = 0.05;
+	static constexpr size_t BUCKETS = 5000;
+
+	std::array<uint32_t, BUCKETS> histogram {};
+	size_t frames = 0;
+	double total = 0;
+	double worst = 0;
+
+	void Add(double milliseconds) {
+		histogram[std::min<size_t>(milliseconds / BUCKET_MS, BUCKETS - 1)]++;
+		frames++;
+		total += milliseconds;
+		worst = std::max(worst, milliseconds);
+	}
+
+	// Upper edge of the bucket holding the given fraction of frames
+	double Percentile(double fraction) const {
+		const auto target = static_cast<size_t>(std::ceil(fraction * frames));
+		size_t count = 0;
+		for (size_t i = 0; i < BUCKETS; i++) {
+			if ((count += histogram[i]) >= target)
+				return std::min(BUCKET_MS * (i + 1), worst);
+		}
+		return worst;
+	}
+
+	void Report(std::ostream& out) const {
+		if (frames == 0)
+			return;
+		out << std::fixed << std::setprecision(2)
+			<< "[INFO]: Input latency over " << frames << " frames: "
+			<< total / frames << " ms average, "
+			<< Percentile(0.5) << " ms median, "
+			<< Percentile(0.99) << " ms 99th percentile" << std::endl;
+	}
+};
+
+auto main(int argc, char* argv[]) -> int {
+	// PWADs to layer over the IWAD, given as: -file a.wad b.wad ...
+	// Demos are given as -record, -playdemo or -timedemo followed by a path;
+	// a timedemo runs one update per frame, as fast as possible, then quits.
+	// Frames go to a shared memory ring with -framering NAME, to a .y4m or
+	// .ppm stream with -capture PATH, and not to a window with -nowindow;
+	// -fps N caps the frame rate instead of settings::FRAME_RATE. Captures
+	// play back at a fixed rate, so they are always paced, at UPDATE_RATE
+	// when uncapped, except in a timedemo, where each frame is one update
+	std::vector<std::string> patchFiles;
+	std::string recordDemo, playDemo, frameRingName, capturePath;
+	auto frameRate = settings::FRAME_RATE;
+	auto timeDemo = false;
+	auto showWindow = true;
+	for (auto i = 1; i < argc; i++) {
+		const auto arg = std::string(argv[i]);
+		if (arg == "-file") {
+			while (i + 1 < argc && argv[i + 1][0] != '-')
+				patchFiles.push_back(argv[++i]);
+		} else if (arg == "-record" && i + 1 < argc) {
+			recordDemo = argv[++i];
+		} else if ((arg == "-playdemo" || arg == "-timedemo") && i + 1 < argc) {
+			playDemo = argv[++i];
+			timeDemo = arg == "-timedemo";
+		} else if (arg == "-framering" && i + 1 < argc) {
+			frameRingName = argv[++i];
+		} else if (arg == "-capture" && i + 1 < argc) {
+			capturePath = argv[++i];
+		} else if (arg == "-nowindow") {
+			showWindow = false;
+		} else if (arg == "-fps" && i + 1 < argc) {
+			frameRate = std::max(0, std::atoi(argv[++i]));
+		}
+	}
+
+	if (!capturePath.empty() && !timeDemo && frameRate == 0)
+		frameRate = settings::UPDATE_RATE;
+
+	// Initialize SDL; without a window, events are still needed to quit on SIGINT
+	if (SDL_Init(showWindow ? SDL_INIT_VIDEO : SDL_INIT_EVENTS) < 0) {
 		std::cerr << "SDL_Init: " << SDL_GetError() << std::endl;
 		return 1;
 	}
-	auto window = SDL_CreateWindow("DOOM", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, settings::WIDTH * settings::SCALE, settings::HEIGHT * settings::SCALE, 0);
-	if (!window) {
-		SDL_Quit();
-		std::cerr << "SDL_CreateWindow: " << SDL_GetError() << std::endl;
-		return 1;
+	SDL_Window* window = nullptr;
+	std::unique_ptr<Presenter> presenter;
+	if (showWindow) {
+		window = SDL_CreateWindow("DOOM", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, settings::WIDTH * settings::SCALE, settings::HEIGHT * settings::SCALE, 0);
+		if (!window) {
+			SDL_Quit();
+			std::cerr << "SDL_CreateWindow: " << SDL_GetError() << std::endl;
+			return 1;
+		}
+		SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+		SDL_SetRelativeMouseMode(SDL_TRUE);
+		presenter = std::make_unique<Presenter>(window, settings::PRESENT_THREAD);
+	}
+
+	// With a frame ring, frames are drawn straight into its slots, which
+	// the window shows from; otherwise into surfaces of their own, two of
+	// them when one may still be being presented while the next is drawn
+	std::unique_ptr<FrameRing> frameRing;
+	std::vector<SDL_Surface*> screens;
+	if (!frameRingName.empty() || !capturePath.empty()) {
+		frameRing = std::make_unique<FrameRing>(frameRingName, settings::WIDTH, settings::HEIGHT, settings::FRAME_RING_SLOTS);
+		for (size_t i = 0; i < frameRing->GetSlotCount(); i++)
+			screens.push_back(SDL_CreateRGBSurfaceFrom(frameRing->GetPixels(i), settings::WIDTH, settings::HEIGHT, 32, settings::WIDTH * 4, 0, 0, 0, 0));
+	} else {
+		for (auto i = 0; i < (presenter && presenter->IsThreaded() ? 2 : 1); i++)
+			screens.push_back(SDL_CreateRGBSurface(0, settings::WIDTH, settings::HEIGHT, 32, 0, 0, 0, 0));
 	}
-	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
-	SDL_SetRelativeMouseMode(SDL_TRUE);
-	auto windowSurface = SDL_GetWindowSurface(window);
-	auto windowSurfaceRect = SDL_Rect { 0, 0, settings::WIDTH * settings::SCALE, settings::HEIGHT * settings::SCALE };
-	auto screen = SDL_CreateRGBSurface(0, settings::WIDTH, settings::HEIGHT, 32, 0, 0, 0, 0);
-	auto screenRect = SDL_Rect { 0, 0, settings::WIDTH, settings::HEIGHT };
 
 	// Initialize game
-	auto game = Game { reinterpret_cast<uint32_t*>(screen->pixels) };
+	auto game = Game { reinterpret_cast<uint32_t*>(screens.front()->pixels), patchFiles };
+	if (!playDemo.empty())
+		game.PlayDemo(playDemo);
+	if (!recordDemo.empty())
+		game.RecordDemo(recordDemo);
+	std::unique_ptr<FrameWriter> frameWriter;
+	if (!capturePath.empty())
+		frameWriter = std::make_unique<FrameWriter>(*frameRing, capturePath, timeDemo ? settings::UPDATE_RATE : frameRate);
 
-	// Main loop
+	// Main loop: real time is spent in fixed simulation steps, and every
+	// frame is drawn between the last two steps by the time left over
+	const auto frequency = SDL_GetPerformanceFrequency();
+	const auto ticksPerUpdate = frequency / settings::UPDATE_RATE;
+	FramePacer pacer { timeDemo ? 0 : frameRate };
+	auto past = SDL_GetPerformanceCounter();
+	Uint64 accumulator = 0;
+	size_t frames = 0;
+	std::vector<Uint64> frameTimes;
+	InputLatencies inputLatencies;
 	auto quit = false;
 	SDL_Event event;
 	while (!quit) {
-		Uint64 past = SDL_GetTicks64();
+		const auto frameStart = SDL_GetPerformanceCounter();
 		while (SDL_PollEvent(&event)) {
 			switch (event.type) {
 			case SDL_QUIT:
@@ -54,20 +199,63 @@ auto main() -> int {
 				break;
 			}
 		}
-		game.Update();
+
+		if (timeDemo) {
+			if (!game.IsPlayingDemo())
+				break;
+			game.Update();
+		} else {
+			// After a long stall, drop the backlog instead of trying to catch up
+			accumulator += frameStart - past;
+			past = frameStart;
+			if (accumulator > ticksPerUpdate * MAX_UPDATES_PER_FRAME)
+				accumulator = ticksPerUpdate * MAX_UPDATES_PER_FRAME;
+			while (accumulator >= ticksPerUpdate) {
+				game.Update();
+				accumulator -= ticksPerUpdate;
+			}
+		}
+
+		// Late latch: motion that arrived during the updates still reaches this frame
+		if (settings::LATE_LATCH_MOUSE) {
+			SDL_PumpEvents();
+			while (SDL_PeepEvents(&event, 1, SDL_GETEVENT, SDL_MOUSEMOTION, SDL_MOUSEMOTION) > 0)
+				game.MouseMoved(event.motion);
+		}
+
+		const auto screen = screens[frameRing ? frameRing->Begin() : frames++ % screens.size()];
+		game.SetScreen(reinterpret_cast<uint32_t*>(screen->pixels));
 		SDL_LockSurface(screen);
-		game.Render();
+		game.Render(timeDemo ? 1.0 : static_cast<double>(accumulator) / ticksPerUpdate);
 		SDL_UnlockSurface(screen);
-		SDL_BlitScaled(screen, &screenRect, windowSurface, &windowSurfaceRect);
-		SDL_UpdateWindowSurface(window);
-		Uint64 now = SDL_GetTicks64();
-		if (now > past + MS_PER_UPDATE)
-			printf("Running %lu ms late.\n", now - past - MS_PER_UPDATE);
-		else
-			SDL_Delay(past + MS_PER_UPDATE - SDL_GetTicks64());
+		if (frameRing)
+			frameRing->End();
+		if (presenter) {
+			allocations::Scope scope { allocations::Phase::PRESENT };
+			presenter->Present(screen);
+		}
+		if (const auto inputTime = game.GetShownInputTime())
+			inputLatencies.Add((SDL_GetPerformanceCounter() - inputTime) * 1000.0 / frequency);
+		allocations::EndFrame();
+
+		if (timeDemo)
+			frameTimes.push_back(SDL_GetPerformanceCounter() - frameStart);
+		pacer.Wait();
 	}
 
-	// Clean up
-	SDL_DestroyWindow(window);
+	if (timeDemo)
+		ReportTimedemo(frameTimes, frequency);
+	pacer.Report(std::cout);
+	inputLatencies.Report(std::cout);
+	allocations::Report(std::cout);
+
+	// Clean up; presentation and capture finish before the frames under them go
+	presenter.reset();
+	frameWriter.reset();
+	for (auto screen : screens)
+		SDL_FreeSurface(screen);
+	frameRing.reset();
+	if (window)
+		SDL_DestroyWindow(window);
 	SDL_Quit();
 }
\ No newline at end of file
@@ -4,30 +4,39 @@
 #include <climits>
 #include <iostream>
 #include <memory>
-#include <stack>
+#include <unordered_set>
+#include <zlib.h>
 
+#include "allocations.h"
+#include "nodebuilder.h"
 #include "player.h"
+#include "settings.h"
 
 /*
  * Sector
  */
-Sector::Sector(double floorHeight, double ceilingHeight, std::shared_ptr<Texture> floorTexture, std::shared_ptr<Texture> ceilingTexture, double lightLevel):
+Sector::Sector(double floorHeight, double ceilingHeight, const Texture* floorTexture, const Texture* ceilingTexture, double lightLevel, int type, int tag):
 	ceilingHeight {ceilingHeight},
 	floorHeight {floorHeight},
 	floorTexture {floorTexture},
 	ceilingTexture {ceilingTexture},
 	lightLevel {lightLevel},
+	type {type},
+	tag {tag},
 	timer {0},
 	open {false},
 	close {false},
-	isSky {ceilingTexture->name == "F_SKY1"}
+	isSky {ceilingTexture->name == "F_SKY1"},
+	initialCeilingHeight {ceilingHeight},
+	initialFloorHeight {floorHeight}
 {
 }
 
-void Sector::Update() {
+// Returns whether the sector is still moving
+bool Sector::Update() {
 	if (timer > 0) {
 		timer--;
-		return;
+		return true;
 	}
 	if (open && ceilingHeight < floorHeight + 64) {
 		if (++ceilingHeight == floorHeight + 64) {
@@ -41,6 +50,7 @@ void Sector::Update() {
 			close = false;
 		}
 	}
+	return open || close;
 }
 
 void Sector::Trigger() {
@@ -54,8 +64,34 @@ void Sector::Trigger() {
  * Map
  */
 Map::Map(WAD& wad, const std::string& name) {
+	allocations::Scope scope { allocations::Phase::LOAD_MAP };
+	if (LoadCache(wad, name)) {
+		BuildIndexes();
+		return;
+	}
+
 	auto lumps = wad.GetMapLumps(name);
 
+	// Built here, then shared by every copy of this map
+	auto built = std::make_shared<MapGeometry>();
+	built->name = name;
+	built->wadHash = wad.GetHash();
+	auto& textures = built->textures;
+	auto& walls = built->walls;
+	auto& sides = built->sides;
+	auto& segs = built->segs;
+	auto& subsectors = built->subsectors;
+	auto& nodes = built->nodes;
+	auto& things = built->things;
+
+	// Keep one reference per distinct texture, so the rest of the map can use raw pointers
+	std::unordered_set<const Texture*> pinned;
+	const auto pin = [&](std::shared_ptr<Texture> texture) -> const Texture* {
+		if (texture != nullptr && pinned.insert(texture.get()).second)
+			textures.push_back(texture);
+		return texture.get();
+	};
+
 	// Structural data
 	std::vector<Vertex> vertices;
 	auto verticesIterator = lumps.find("VERTEXES");
@@ -63,11 +99,10 @@ Map::Map(WAD& wad, const std::string& name) {
 		std::cerr << "Error: no VERTEXES lump" << std::endl;
 		exit(1);
 	}
-	auto verticesLump = verticesIterator->second.get();
-	wad.seek(verticesLump->location);
-	for (uint32_t i = 0; i < verticesLump->size; i += 4) {
-		const auto x = wad.read<int16_t>();
-		const auto y = wad.read<int16_t>();
+	const auto verticesData = wad.GetLumpData(*verticesIterator->second);
+	for (size_t i = 0; i + 4 <= verticesData.size; i += 4) {
+		const auto x = verticesData.Get<int16_t>(i);
+		const auto y = verticesData.Get<int16_t>(i + 2);
 
 		vertices.push_back(Vertex {
 			(double) x,
@@ -80,26 +115,24 @@ Map::Map(WAD& wad, const std::string& name) {
 		std::cerr << "Error: no SECTORS lump" << std::endl;
 		exit(1);
 	}
-	auto sectorsLump = sectorsIterator->second.get();
-	wad.seek(sectorsLump->location);
-	for (uint32_t i = 0; i < sectorsLump->size; i += 26) {
-		const auto floorHeight = wad.read<int16_t>();
-		const auto ceilingHeight = wad.read<int16_t>();
-		const auto floorTexture = wad.readString(8);
-		const auto ceilingTexture = wad.readString(8);
-		const auto lightLevel = wad.read<int16_t>();
-		const auto type = wad.read<int16_t>();
-		const auto tag = wad.read<int16_t>();
-
-		std::ignore = type;
-		std::ignore = tag;
+	const auto sectorsData = wad.GetLumpData(*sectorsIterator->second);
+	for (size_t i = 0; i + 26 <= sectorsData.size; i += 26) {
+		const auto floorHeight = sectorsData.Get<int16_t>(i);
+		const auto ceilingHeight = sectorsData.Get<int16_t>(i + 2);
+		const auto floorTexture = sectorsData.GetString(i + 4, 8);
+		const auto ceilingTexture = sectorsData.GetString(i + 12, 8);
+		const auto lightLevel = sectorsData.Get<int16_t>(i + 20);
+		const auto type = sectorsData.Get<int16_t>(i + 22);
+		const auto tag = sectorsData.Get<int16_t>(i + 24);
 
 		sectors.push_back(Sector {
 			(double) floorHeight,
 			(double) ceilingHeight,
-			wad.GetFlat(floorTexture),
-			wad.GetFlat(ceilingTexture),
+			pin(wad.GetFlat(floorTexture)),
+			pin(wad.GetFlat(ceilingTexture)),
 			(double) lightLevel / 255.0,
+			type,
+			tag,
 		});
 	}
 
@@ -108,23 +141,22 @@ Map::Map(WAD& wad, const std::string& name) {
 		std::cerr << "Error: no SIDEDEFS lump" << std::endl;
 		exit(1);
 	}
-	auto sidedefsLump = sidedefsIterator->second.get();
-	wad.seek(sidedefsLump->location);
-	for (uint32_t i = 0; i < sidedefsLump->size; i += 30) {
-		const auto xOffset = wad.read<int16_t>();
-		const auto yOffset = wad.read<int16_t>();
-		const auto upperTexture = wad.readString(8);
-		const auto lowerTexture = wad.readString(8);
-		const auto middleTexture = wad.readString(8);
-		const auto sector = wad.read<int16_t>();
+	const auto sidedefsData = wad.GetLumpData(*sidedefsIterator->second);
+	for (size_t i = 0; i + 30 <= sidedefsData.size; i += 30) {
+		const auto xOffset = sidedefsData.Get<int16_t>(i);
+		const auto yOffset = sidedefsData.Get<int16_t>(i + 2);
+		const auto upperTexture = sidedefsData.GetString(i + 4, 8);
+		const auto lowerTexture = sidedefsData.GetString(i + 12, 8);
+		const auto middleTexture = sidedefsData.GetString(i + 20, 8);
+		const auto sector = sidedefsData.Get<uint16_t>(i + 28);
 
 		sides.push_back({
 			xOffset,
 			yOffset,
-			wad.GetTexture(upperTexture),
-			wad.GetTexture(lowerTexture),
-			wad.GetTexture(middleTexture),
-			&sectors[sector]
+			pin(wad.GetTexture(upperTexture)),
+			pin(wad.GetTexture(lowerTexture)),
+			pin(wad.GetTexture(middleTexture)),
+			sector
 		});
 	}
 
@@ -133,91 +165,257 @@ Map::Map(WAD& wad, const std::string& name) {
 		std::cerr << "Error: no LINEDEFS lump" << std::endl;
 		exit(1);
 	}
-	auto linedefsLump = linedefsIterator->second.get();
-	wad.seek(linedefsLump->location);
-	for (uint32_t i = 0; i < linedefsLump->size; i += 14) {
-		const auto startVertex = wad.read<int16_t>();
-		const auto endVertex = wad.read<int16_t>();
-		const auto flags = wad.read<int16_t>();
-		const auto specialType = wad.read<int16_t>();
-		const auto sectorTag = wad.read<int16_t>();
-		const auto rightSidedef = wad.read<int16_t>();
-		const auto leftSidedef = wad.read<int16_t>();
-
-		std::ignore = sectorTag;
+	const auto linedefsData = wad.GetLumpData(*linedefsIterator->second);
+	for (size_t i = 0; i + 14 <= linedefsData.size; i += 14) {
+		const auto startVertex = linedefsData.Get<uint16_t>(i);
+		const auto endVertex = linedefsData.Get<uint16_t>(i + 2);
+		const auto flags = linedefsData.Get<int16_t>(i + 4);
+		const auto specialType = linedefsData.Get<int16_t>(i + 6);
+		const auto sectorTag = linedefsData.Get<int16_t>(i + 8);
+		// Indices are unsigned, so maps may use up to 65535 of each; 0xffff means no side
+		const auto rightSidedef = linedefsData.Get<uint16_t>(i + 10);
+		const auto leftSidedef = linedefsData.Get<uint16_t>(i + 12);
 
 		walls.push_back({
 			vertices[startVertex],
 			vertices[endVertex],
-			flags,
 			specialType,
-			rightSidedef == -1 ? nullptr : &sides[rightSidedef],
-			leftSidedef == -1 ? nullptr : &sides[leftSidedef],
+			flags,
+			sectorTag,
+			rightSidedef == 0xffff ? nullptr : &sides[rightSidedef],
+			leftSidedef == 0xffff ? nullptr : &sides[leftSidedef],
 		});
 	}
 
-	// Binary-space partition data
+	// Binary-space partition data, built here if the map ships without it
 	auto segsIterator = lumps.find("SEGS");
-	if (segsIterator == lumps.end()) {
-		std::cerr << "Error: no SEGS lump" << std::endl;
+	auto subsectorsIterator = lumps.find("SSECTORS");
+	auto nodesIterator = lumps.find("NODES");
+	const auto nodesData = nodesIterator == lumps.end() ? LumpData { nullptr, 0 } : wad.GetLumpData(*nodesIterator->second);
+	const auto extendedNodes = nodesData.size >= 4 && (std::memcmp(nodesData.data, "XNOD", 4) == 0 || std::memcmp(nodesData.data, "ZNOD", 4) == 0);
+	auto buildNodes = settings::REBUILD_NODES || (!extendedNodes && (segsIterator == lumps.end() || subsectorsIterator == lumps.end() || nodesIterator == lumps.end()));
+	if (!buildNodes && extendedNodes && !LoadExtendedNodes(*built, nodesData, vertices)) {
+		std::cerr << "[WARN]: Rejected the extended nodes of " << name << ", building nodes instead" << std::endl;
+		buildNodes = true;
+	}
+	if (buildNodes) {
+		NodeBuilder builder { walls };
+		builder.Build(*built);
+		builder.Report(std::cout, name);
+		builtNodes = true;
+	} else if (!extendedNodes) {
+		const auto segsData = wad.GetLumpData(*segsIterator->second);
+		for (size_t i = 0; i + 12 <= segsData.size; i += 12) {
+			const auto startVertex = segsData.Get<uint16_t>(i);
+			const auto endVertex = segsData.Get<uint16_t>(i + 2);
+			const auto angle = segsData.Get<int16_t>(i + 4);
+			const auto linedef = segsData.Get<uint16_t>(i + 6);
+			const auto direction = segsData.Get<int16_t>(i + 8);
+			const auto xOffset = segsData.Get<int16_t>(i + 10);
+
+			std::ignore = angle;
+
+			segs.push_back(std::make_shared<Segment>(Segment {
+				vertices[startVertex],
+				vertices[endVertex],
+				walls[linedef],
+				direction == 1,
+				xOffset,
+			}));
+		}
+
+		const auto subsectorsData = wad.GetLumpData(*subsectorsIterator->second);
+		for (size_t i = 0; i + 4 <= subsectorsData.size; i += 4) {
+			const auto segCount = subsectorsData.Get<uint16_t>(i);
+			const auto firstSeg = subsectorsData.Get<uint16_t>(i + 2);
+
+			std::vector<std::shared_ptr<Segment>> segments;
+			for (uint16_t i = 0; i < segCount; i++)
+				segments.push_back(segs[firstSeg + i]);
+			subsectors.push_back(std::make_shared<SubSector>(SubSector {
+				segments
+			}));
+		}
+
+		// Widen vanilla child indices, which flag subsectors with the top bit of 16
+		const auto child = [](uint16_t index) -> uint32_t {
+			return (index & 0x8000) ? Node::SUBSECTOR | (index & 0x7fff) : index;
+		};
+		for (size_t i = 0; i + 28 <= nodesData.size; i += 28) {
+			int16_t x = nodesData.Get<int16_t>(i);
+			int16_t y = nodesData.Get<int16_t>(i + 2);
+			int16_t dx = nodesData.Get<int16_t>(i + 4);
+			int16_t dy = nodesData.Get<int16_t>(i + 6);
+			// 16 bytes of bounding boxes are not used
+			uint16_t rightChild = nodesData.Get<uint16_t>(i + 24);
+			uint16_t leftChild = nodesData.Get<uint16_t>(i + 26);
+			nodes.push_back({
+				(double) x, (double) y,
+				(double) dx, (double) dy,
+				child(rightChild),
+				child(leftChild),
+			});
+		}
+	}
+
+	// Entity data
+	auto thingsIterator = lumps.find("THINGS");
+	if (thingsIterator == lumps.end()) {
+		std::cerr << "Error: no THINGS lump" << std::endl;
 		exit(1);
 	}
-	auto segsLump = segsIterator->second.get();
-	wad.seek(segsLump->location);
-	for (uint32_t i = 0; i < segsLump->size; i += 12) {
-		const auto startVertex = wad.read<int16_t>();
-		const auto endVertex = wad.read<int16_t>();
-		const auto angle = wad.read<int16_t>();
-		const auto linedef = wad.read<int16_t>();
-		const auto direction = wad.read<int16_t>();
-		const auto xOffset = wad.read<int16_t>();
-
-		std::ignore = angle;
+	const auto thingsData = wad.GetLumpData(*thingsIterator->second);
+	for (size_t i = 0; i + 10 <= thingsData.size; i += 10) {
+		int16_t x = thingsData.Get<int16_t>(i);
+		int16_t y = thingsData.Get<int16_t>(i + 2);
+		int16_t angle = thingsData.Get<int16_t>(i + 4);
+		int16_t type = thingsData.Get<int16_t>(i + 6);
+		things.push_back({
+			(double) x, (double) y,
+			M_PI * (double) (angle + 0x4000) / (double) 0x8000,
+			(Thing::Type) type,
+		});
+	}
+
+	geometry = std::move(built);
+	BuildIndexes();
+	StoreCache(wad, name);
+}
+
+Map::Map(const Map& other):
+	geometry { other.geometry },
+	sectors { other.sectors },
+	builtNodes { other.builtNodes }
+{
+	for (auto s : other.activeSectors)
+		activeSectors.push_back(&sectors[s - other.sectors.data()]);
+	BuildIndexes();
+}
+
+/*
+ * Extended nodes
+ *
+ * The XNOD layout from ZDoom, or ZNOD for the same data deflated, stored in
+ * the NODES lump in place of vanilla SEGS, SSECTORS and NODES. Every index is
+ * 32 bits wide, and partitions may add vertices given in 16.16 fixed point.
+ */
+bool Map::LoadExtendedNodes(MapGeometry& geometry, const LumpData& lump, const std::vector<Vertex>& mapVertices) {
+	const auto& walls = geometry.walls;
+	auto& segs = geometry.segs;
+	auto& subsectors = geometry.subsectors;
+	auto& nodes = geometry.nodes;
+	auto data = LumpData { lump.data + 4, lump.size - 4 };
+	std::vector<uint8_t> inflated;
+	if (std::memcmp(lump.data, "ZNOD", 4) == 0) {
+		z_stream stream {};
+		stream.next_in = const_cast<Bytef*>(data.data);
+		stream.avail_in = data.size;
+		auto status = inflateInit(&stream);
+		while (status == Z_OK) {
+			inflated.resize(inflated.size() + std::max<size_t>(data.size * 2, 4096));
+			stream.next_out = inflated.data() + stream.total_out;
+			stream.avail_out = inflated.size() - stream.total_out;
+			status = inflate(&stream, Z_NO_FLUSH);
+		}
+		inflateEnd(&stream);
+		if (status != Z_STREAM_END) {
+			std::cerr << "Error: could not inflate ZNOD nodes" << std::endl;
+			exit(1);
+		}
+		inflated.resize(stream.total_out);
+		data = LumpData { inflated.data(), inflated.size() };
+	}
 
+	size_t offset = 0;
+	const auto count = [&](size_t recordSize) {
+		if (offset + 4 > data.size || offset + 4 + data.Get<uint32_t>(offset) * recordSize > data.size) {
+			std::cerr << "Error: truncated extended nodes" << std::endl;
+			exit(1);
+		}
+		offset += 4;
+		return data.Get<uint32_t>(offset - 4);
+	};
+
+	// Vertices created by splits follow those from VERTEXES; nodes built for
+	// other VERTEXES would have every later index point at the wrong vertex
+	const auto originalCount = count(0);
+	if (originalCount != mapVertices.size()) {
+		std::cerr << "[WARN]: Extended nodes expect " << originalCount << " vertices, the map has " << mapVertices.size() << std::endl;
+		return false;
+	}
+	std::vector<Vertex> vertices(mapVertices);
+	const auto newCount = count(8);
+	for (uint32_t i = 0; i < newCount; i++, offset += 8) {
+		vertices.push_back(Vertex {
+			data.Get<int32_t>(offset) / 65536.0,
+			data.Get<int32_t>(offset + 4) / 65536.0,
+		});
+	}
+
+	// Subsectors only store their seg count, their segs being consecutive
+	std::vector<uint32_t> segCounts(count(4));
+	for (auto& segCount : segCounts) {
+		segCount = data.Get<uint32_t>(offset);
+		offset += 4;
+	}
+
+	const auto segCount = count(11);
+	for (uint32_t i = 0; i < segCount; i++, offset += 11) {
+		const auto startVertex = data.Get<uint32_t>(offset);
+		const auto endVertex = data.Get<uint32_t>(offset + 4);
+		const auto linedef = data.Get<uint16_t>(offset + 8);
+		const auto side = data.Get<uint8_t>(offset + 10);
+		if (startVertex >= vertices.size() || endVertex >= vertices.size() || linedef >= walls.size()) {
+			std::cerr << "Error: invalid extended seg " << i << std::endl;
+			exit(1);
+		}
+
+		// The texture offset is not stored, so measure it along the linedef
+		const auto& wall = walls[linedef];
+		const auto& origin = side == 1 ? wall.e : wall.s;
+		const auto& start = vertices[startVertex];
 		segs.push_back(std::make_shared<Segment>(Segment {
-			vertices[startVertex],
+			start,
 			vertices[endVertex],
-			walls[linedef],
-			direction == 1,
-			xOffset,
+			wall,
+			side == 1,
+			static_cast<int>(std::lround(std::hypot(start.x - origin.x, start.y - origin.y))),
 		}));
 	}
 
-	auto subsectorsIterator = lumps.find("SSECTORS");
-	if (subsectorsIterator == lumps.end()) {
-		std::cerr << "Error: no SSECTORS lump" << std::endl;
-		exit(1);
-	}
-	auto subsectorsLump = subsectorsIterator->second.get();
-	wad.seek(subsectorsLump->location);
-	for (uint32_t i = 0; i < subsectorsLump->size; i += 4) {
-		const auto segCount = wad.read<int16_t>();
-		const auto firstSeg = wad.read<int16_t>();
-
-		std::vector<std::shared_ptr<Segment>> segments;
-		for (int16_t i = 0; i < segCount; i++)
-			segments.push_back(segs[firstSeg + i]);
+	size_t firstSeg = 0;
+	for (const auto segCount : segCounts) {
+		if (firstSeg + segCount > segs.size()) {
+			std::cerr << "Error: invalid extended subsector" << std::endl;
+			exit(1);
+		}
 		subsectors.push_back(std::make_shared<SubSector>(SubSector {
-			segments
+			std::vector<std::shared_ptr<Segment>>(segs.begin() + firstSeg, segs.begin() + firstSeg + segCount)
 		}));
+		firstSeg += segCount;
 	}
 
-	auto nodesIterator = lumps.find("NODES");
-	if (nodesIterator == lumps.end()) {
-		std::cerr << "Error: no NODES lump" << std::endl;
-		exit(1);
+	// Traversal starts at the last node and follows children without checks
+	const auto nodeCount = count(32);
+	const auto childInRange = [&](uint32_t child) {
+		return (child & Node::SUBSECTOR) ? (child & ~Node::SUBSECTOR) < subsectors.size() : child < nodeCount;
+	};
+	if (nodeCount == 0) {
+		std::cerr << "[WARN]: Extended nodes have no nodes" << std::endl;
+		return false;
 	}
-	auto nodesLump = nodesIterator->second.get();
-	wad.seek(nodesLump->location);
-	for (uint32_t i = 0; i < nodesLump->size; i += 28) {
-		int16_t x = wad.read<int16_t>();
-		int16_t y = wad.read<int16_t>();
-		int16_t dx = wad.read<int16_t>();
-		int16_t dy = wad.read<int16_t>();
-		for (int i = 0; i < 8; i++)
-			wad.read<int16_t>(); // bounding box
-		int16_t rightChild = wad.read<int16_t>();
-		int16_t leftChild = wad.read<int16_t>();
+	for (uint32_t i = 0; i < nodeCount; i++, offset += 32) {
+		int16_t x = data.Get<int16_t>(offset);
+		int16_t y = data.Get<int16_t>(offset + 2);
+		int16_t dx = data.Get<int16_t>(offset + 4);
+		int16_t dy = data.Get<int16_t>(offset + 6);
+		// 16 bytes of bounding boxes are not used
+		uint32_t rightChild = data.Get<uint32_t>(offset + 24);
+		uint32_t leftChild = data.Get<uint32_t>(offset + 28);
+		if (!childInRange(rightChild) || !childInRange(leftChild)) {
+			std::cerr << "[WARN]: Extended node " << i << " has a child out of range" << std::endl;
+			return false;
+		}
 		nodes.push_back({
 			(double) x, (double) y,
 			(double) dx, (double) dy,
@@ -225,58 +423,91 @@ Map::Map(WAD& wad, const std::string& name) {
 			leftChild,
 		});
 	}
+	return true;
+}
 
-	// Entity data
-	auto thingsIterator = lumps.find("THINGS");
-	if (thingsIterator == lumps.end()) {
-		std::cerr << "Error: no THINGS lump" << std::endl;
-		exit(1);
+void Map::BuildIndexes() {
+	taggedSectors.clear();
+	taggedWalls.clear();
+	// Room for every sector, so triggering one never allocates mid-game
+	activeSectors.reserve(sectors.size());
+	for (auto& sector : sectors) {
+		if (sector.tag != 0)
+			taggedSectors[sector.tag].push_back(&sector);
 	}
-	auto thingsLump = thingsIterator->second.get();
-	wad.seek(thingsLump->location);
-	for (uint32_t i = 0; i < thingsLump->size; i += 10) {
-		int16_t x = wad.read<int16_t>();
-		int16_t y = wad.read<int16_t>();
-		int16_t angle = wad.read<int16_t>();
-		int16_t type = wad.read<int16_t>();
-		wad.read<int16_t>(); // flags
-		things.push_back({
-			(double) x, (double) y,
-			M_PI * (double) (angle + 0x4000) / (double) 0x8000,
-			(Thing::Type) type,
-		});
+	for (const auto& wall : geometry->walls) {
+		if (wall.tag != 0)
+			taggedWalls[wall.tag].push_back(&wall);
 	}
 }
 
 void Map::Update() {
-	for (auto& sector : sectors) {
-		sector.Update();
+	activeSectors.erase(std::remove_if(activeSectors.begin(), activeSectors.end(), [](Sector* sector) {
+		return !sector->Update();
+	}), activeSectors.end());
+}
+
+void Map::Activate(const Wall& wall) {
+	switch (wall.type) {
+	// Doors opening the sector behind the line
+	case 1: case 26: case 27: case 28: case 31: case 32: case 33: case 34:
+		if (wall.twoSided)
+			Trigger(GetSector(*wall.backSide));
+		break;
+	// Doors opening every sector sharing the line's tag
+	case 2: case 4: case 29: case 61: case 63: case 86: case 90: case 103:
+		for (auto sector : GetTaggedSectors(wall.tag))
+			Trigger(*sector);
+		break;
+	default:
+		break;
 	}
 }
 
+void Map::Trigger(Sector& sector) {
+	const auto idle = !sector.open && !sector.close;
+	sector.Trigger();
+	if (idle)
+		activeSectors.push_back(&sector);
+}
+
+const std::vector<Sector*>& Map::GetTaggedSectors(int tag) const {
+	static const std::vector<Sector*> none;
+	auto it = taggedSectors.find(tag);
+	return it == taggedSectors.end() ? none : it->second;
+}
+
+const std::vector<const Wall*>& Map::GetTaggedWalls(int tag) const {
+	static const std::vector<const Wall*> none;
+	auto it = taggedWalls.find(tag);
+	return it == taggedWalls.end() ? none : it->second;
+}
+
 bool Map::IsInFrontOf(const Player& player, const Node& node) {
 	const auto dx = player.x - node.x;
 	const auto dy = player.y - node.y;
 	return ((dx * node.dy) - (dy * node.dx)) >= 0;
 }
 
-std::vector<std::shared_ptr<Segment>> Map::GetOrderedSegments(const Player& player) const {
-	std::vector<std::shared_ptr<Segment>> segments;
-	std::stack<int> queue;
-	queue.push(nodes.size() - 1);
+std::pmr::vector<const Segment*> Map::GetOrderedSegments(const Player& player, std::pmr::memory_resource* resource) const {
+	std::pmr::vector<const Segment*> segments { resource };
+	std::pmr::vector<uint32_t> queue { resource };
+	const auto& nodes = geometry->nodes;
+	const auto& subsectors = geometry->subsectors;
+	queue.push_back(nodes.size() - 1);
 	while (!queue.empty()) {
-		int node = queue.top();
-		queue.pop();
-		if (node & 0x8000) {
-			for (const auto& segment : subsectors[node & 0x7fff]->segments) {
-				segments.push_back(segment);
+		uint32_t node = queue.back();
+		queue.pop_back();
+		if (node & Node::SUBSECTOR) {
+			for (const auto& segment : subsectors[node & ~Node::SUBSECTOR]->segments) {
+				segments.push_back(segment.get());
 			}
 		} else if (IsInFrontOf(player, nodes[node])) {
-			queue.push(nodes[node].leftChild);
-			queue.push(nodes[node].rightChild);
+			queue.push_back(nodes[node].leftChild);
+			queue.push_back(nodes[node].rightChild);
 		} else {
-			queue.push(nodes[node].rightChild);
-			queue.push(nodes[node].leftChild);
+			queue.push_back(nodes[node].rightChild);
+			queue.push_back(nodes[node].leftChild);
 		}
 	}
 	return segments;
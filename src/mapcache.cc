@@ -0,0 +1,403 @@
+#include "map.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "settings.h"
+
+/*
+ * On-disk layout
+ *
+ * A header followed by flat arrays of fixed-size records, in the order the
+ * counts appear in the header. Pointers are stored as indices and textures
+ * as indices into the flat and texture name tables, so a load is one mmap
+ * and a single pass that fixes the references up.
+ */
+namespace {
+	constexpr char MAGIC[4] = { 'D', 'M', 'A', 'P' };
+	constexpr uint32_t VERSION = 5;
+
+	// Header flags
+	constexpr uint32_t BUILT_NODES = 1 << 0;
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint64_t contentHash;
+		char name[8];
+		uint32_t flatCount;
+		uint32_t textureCount;
+		uint32_t sectorCount;
+		uint32_t sideCount;
+		uint32_t wallCount;
+		uint32_t segCount;
+		uint32_t subsectorCount;
+		uint32_t nodeCount;
+		uint32_t thingCount;
+		uint32_t flags;
+	};
+
+	struct NameRecord {
+		char name[8];
+	};
+
+	struct SectorRecord {
+		double floorHeight, ceilingHeight;
+		double lightLevel;
+		int32_t floorTexture, ceilingTexture;
+		int32_t type, tag;
+	};
+
+	struct SideRecord {
+		int32_t xOffset, yOffset;
+		int32_t upperTexture, lowerTexture, middleTexture;
+		int32_t sector;
+	};
+
+	struct WallRecord {
+		double sx, sy, ex, ey;
+		int32_t type, flags, tag;
+		int32_t frontSide, backSide;
+		int32_t reserved;
+	};
+
+	struct SegmentRecord {
+		double sx, sy, ex, ey;
+		int32_t type, flags, tag;
+		int32_t frontSide, backSide;
+		int32_t xOffset;
+	};
+
+	struct SubSectorRecord {
+		int32_t firstSegment, segmentCount;
+	};
+
+	struct NodeRecord {
+		double x, y, dx, dy;
+		uint32_t rightChild, leftChild;
+	};
+
+	struct ThingRecord {
+		double x, y, angle;
+		int32_t type, reserved;
+	};
+
+	// One file per map of each WAD stack, so switching stacks keeps each cache
+	std::string CachePath(const std::string& name, uint64_t contentHash) {
+		std::ostringstream path;
+		path << settings::CACHE_DIRECTORY << "/" << name << "-" << std::hex << std::setw(16) << std::setfill('0') << contentHash << ".map";
+		return path.str();
+	}
+
+	// Interns texture names, handing out one index per distinct texture
+	class NameInterner {
+		std::unordered_map<const Texture*, int32_t> indices;
+	public:
+		std::vector<NameRecord> names;
+
+		int32_t Add(const Texture* texture) {
+			if (texture == nullptr)
+				return -1;
+			auto it = indices.find(texture);
+			if (it != indices.end())
+				return it->second;
+			NameRecord record {};
+			std::strncpy(record.name, texture->name.c_str(), sizeof(record.name));
+			names.push_back(record);
+			return indices[texture] = static_cast<int32_t>(names.size() - 1);
+		}
+	};
+
+	template <typename T>
+	const T* Next(const uint8_t*& cursor, uint32_t count) {
+		const auto records = reinterpret_cast<const T*>(cursor);
+		cursor += count * sizeof(T);
+		return records;
+	}
+
+	template <typename T>
+	void Write(std::ofstream& file, const std::vector<T>& records) {
+		file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(T));
+	}
+}
+
+/*
+ * Map
+ */
+bool Map::LoadCache(WAD& wad, const std::string& name) {
+	const auto path = CachePath(name, wad.GetContentHash());
+	const auto fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+		close(fd);
+		return false;
+	}
+	const auto size = static_cast<size_t>(st.st_size);
+	const auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+
+	const auto base = static_cast<const uint8_t*>(data);
+	const auto& header = *reinterpret_cast<const Header*>(base);
+	char headerName[9] = {};
+	std::memcpy(headerName, header.name, sizeof(header.name));
+	const auto expectedSize = sizeof(Header)
+		+ (static_cast<size_t>(header.flatCount) + header.textureCount) * sizeof(NameRecord)
+		+ header.sectorCount * sizeof(SectorRecord)
+		+ header.sideCount * sizeof(SideRecord)
+		+ header.wallCount * sizeof(WallRecord)
+		+ header.segCount * sizeof(SegmentRecord)
+		+ header.subsectorCount * sizeof(SubSectorRecord)
+		+ header.nodeCount * sizeof(NodeRecord)
+		+ header.thingCount * sizeof(ThingRecord);
+	if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION
+			|| header.contentHash != wad.GetContentHash() || name != headerName || size != expectedSize
+			|| (settings::REBUILD_NODES && !(header.flags & BUILT_NODES))) {
+		munmap(data, size);
+		return false;
+	}
+
+	auto cursor = base + sizeof(Header);
+	const auto flatNames = Next<NameRecord>(cursor, header.flatCount);
+	const auto textureNames = Next<NameRecord>(cursor, header.textureCount);
+	const auto sectorRecords = Next<SectorRecord>(cursor, header.sectorCount);
+	const auto sideRecords = Next<SideRecord>(cursor, header.sideCount);
+	const auto wallRecords = Next<WallRecord>(cursor, header.wallCount);
+	const auto segmentRecords = Next<SegmentRecord>(cursor, header.segCount);
+	const auto subsectorRecords = Next<SubSectorRecord>(cursor, header.subsectorCount);
+	const auto nodeRecords = Next<NodeRecord>(cursor, header.nodeCount);
+	const auto thingRecords = Next<ThingRecord>(cursor, header.thingCount);
+
+	// A stale or damaged file can have the right size and still point past
+	// its tables, so every index is checked before any of it is used
+	const auto inRange = [](int32_t i, uint32_t count) { return i >= 0 && static_cast<uint32_t>(i) < count; };
+	const auto inRangeOrNone = [&](int32_t i, uint32_t count) { return i == -1 || inRange(i, count); };
+	const auto childInRange = [&](uint32_t child) {
+		return (child & Node::SUBSECTOR) ? (child & ~Node::SUBSECTOR) < header.subsectorCount : child < header.nodeCount;
+	};
+	// Traversal starts at the last node
+	auto valid = header.nodeCount > 0;
+	for (uint32_t i = 0; valid && i < header.sectorCount; i++) {
+		const auto& r = sectorRecords[i];
+		valid = inRange(r.floorTexture, header.flatCount) && inRange(r.ceilingTexture, header.flatCount);
+	}
+	for (uint32_t i = 0; valid && i < header.sideCount; i++) {
+		const auto& r = sideRecords[i];
+		valid = inRangeOrNone(r.upperTexture, header.textureCount) && inRangeOrNone(r.lowerTexture, header.textureCount)
+			&& inRangeOrNone(r.middleTexture, header.textureCount) && inRange(r.sector, header.sectorCount);
+	}
+	for (uint32_t i = 0; valid && i < header.wallCount; i++) {
+		const auto& r = wallRecords[i];
+		valid = inRangeOrNone(r.frontSide, header.sideCount) && inRangeOrNone(r.backSide, header.sideCount);
+	}
+	for (uint32_t i = 0; valid && i < header.segCount; i++) {
+		const auto& r = segmentRecords[i];
+		valid = inRangeOrNone(r.frontSide, header.sideCount) && inRangeOrNone(r.backSide, header.sideCount);
+	}
+	for (uint32_t i = 0; valid && i < header.subsectorCount; i++) {
+		const auto& r = subsectorRecords[i];
+		valid = r.firstSegment >= 0 && r.segmentCount >= 0
+			&& static_cast<uint64_t>(r.firstSegment) + static_cast<uint64_t>(r.segmentCount) <= header.segCount;
+	}
+	for (uint32_t i = 0; valid && i < header.nodeCount; i++)
+		valid = childInRange(nodeRecords[i].rightChild) && childInRange(nodeRecords[i].leftChild);
+	if (!valid) {
+		std::cerr << "[WARN]: Map cache '" << path << "' is corrupt, loading from the WAD" << std::endl;
+		munmap(data, size);
+		return false;
+	}
+
+	auto built = std::make_shared<MapGeometry>();
+	built->name = name;
+	built->wadHash = wad.GetHash();
+	auto& textures = built->textures;
+	auto& walls = built->walls;
+	auto& sides = built->sides;
+	auto& segs = built->segs;
+	auto& subsectors = built->subsectors;
+	auto& nodes = built->nodes;
+	auto& things = built->things;
+
+	// Each distinct name is resolved once instead of once per reference
+	std::vector<std::shared_ptr<Texture>> flatHandles, textureHandles;
+	for (uint32_t i = 0; i < header.flatCount; i++)
+		flatHandles.push_back(wad.GetFlat(std::string(flatNames[i].name, strnlen(flatNames[i].name, 8))));
+	for (uint32_t i = 0; i < header.textureCount; i++)
+		textureHandles.push_back(wad.GetTexture(std::string(textureNames[i].name, strnlen(textureNames[i].name, 8))));
+	textures.insert(textures.end(), flatHandles.begin(), flatHandles.end());
+	textures.insert(textures.end(), textureHandles.begin(), textureHandles.end());
+	const auto flat = [&](int32_t i) { return i < 0 ? nullptr : flatHandles[i].get(); };
+	const auto texture = [&](int32_t i) { return i < 0 ? nullptr : textureHandles[i].get(); };
+	const auto side = [&](int32_t i) { return i < 0 ? nullptr : &sides[i]; };
+
+	sectors.reserve(header.sectorCount);
+	for (uint32_t i = 0; i < header.sectorCount; i++) {
+		const auto& r = sectorRecords[i];
+		sectors.push_back(Sector { r.floorHeight, r.ceilingHeight, flat(r.floorTexture), flat(r.ceilingTexture), r.lightLevel, r.type, r.tag });
+	}
+	sides.reserve(header.sideCount);
+	for (uint32_t i = 0; i < header.sideCount; i++) {
+		const auto& r = sideRecords[i];
+		sides.push_back({ r.xOffset, r.yOffset, texture(r.upperTexture), texture(r.lowerTexture), texture(r.middleTexture), static_cast<size_t>(r.sector) });
+	}
+	walls.reserve(header.wallCount);
+	for (uint32_t i = 0; i < header.wallCount; i++) {
+		const auto& r = wallRecords[i];
+		walls.push_back({ Vertex { r.sx, r.sy }, Vertex { r.ex, r.ey }, r.type, r.flags, r.tag, side(r.frontSide), side(r.backSide) });
+	}
+	segs.reserve(header.segCount);
+	for (uint32_t i = 0; i < header.segCount; i++) {
+		const auto& r = segmentRecords[i];
+		const auto s = Vertex { r.sx, r.sy };
+		const auto e = Vertex { r.ex, r.ey };
+		segs.push_back(std::make_shared<Segment>(Segment { s, e, Wall { s, e, r.type, r.flags, r.tag, side(r.frontSide), side(r.backSide) }, false, r.xOffset }));
+	}
+	subsectors.reserve(header.subsectorCount);
+	for (uint32_t i = 0; i < header.subsectorCount; i++) {
+		const auto& r = subsectorRecords[i];
+		subsectors.push_back(std::make_shared<SubSector>(SubSector {
+			std::vector<std::shared_ptr<Segment>>(segs.begin() + r.firstSegment, segs.begin() + r.firstSegment + r.segmentCount)
+		}));
+	}
+	nodes.reserve(header.nodeCount);
+	for (uint32_t i = 0; i < header.nodeCount; i++) {
+		const auto& r = nodeRecords[i];
+		nodes.push_back({ r.x, r.y, r.dx, r.dy, r.rightChild, r.leftChild });
+	}
+	things.reserve(header.thingCount);
+	for (uint32_t i = 0; i < header.thingCount; i++) {
+		const auto& r = thingRecords[i];
+		things.push_back({ r.x, r.y, r.angle, static_cast<Thing::Type>(r.type) });
+	}
+
+	geometry = std::move(built);
+	builtNodes = (header.flags & BUILT_NODES) != 0;
+
+	munmap(data, size);
+	return true;
+}
+
+void Map::StoreCache(const WAD& wad, const std::string& name) const {
+	NameInterner flatNames, textureNames;
+	const auto& walls = geometry->walls;
+	const auto& sides = geometry->sides;
+	const auto& segs = geometry->segs;
+	const auto& subsectors = geometry->subsectors;
+	const auto& nodes = geometry->nodes;
+	const auto& things = geometry->things;
+	const auto sideIndex = [&](const Side* side) { return side == nullptr ? -1 : static_cast<int32_t>(side - sides.data()); };
+
+	std::vector<SectorRecord> sectorRecords;
+	for (const auto& sector : sectors) {
+		sectorRecords.push_back({
+			sector.initialFloorHeight, sector.initialCeilingHeight,
+			sector.lightLevel,
+			flatNames.Add(sector.floorTexture), flatNames.Add(sector.ceilingTexture),
+			sector.type, sector.tag,
+		});
+	}
+	std::vector<SideRecord> sideRecords;
+	for (const auto& side : sides) {
+		sideRecords.push_back({
+			side.xOffset, side.yOffset,
+			textureNames.Add(side.upperTexture), textureNames.Add(side.lowerTexture), textureNames.Add(side.middleTexture),
+			static_cast<int32_t>(side.sector),
+		});
+	}
+	std::vector<WallRecord> wallRecords;
+	for (const auto& wall : walls) {
+		wallRecords.push_back({
+			wall.s.x, wall.s.y, wall.e.x, wall.e.y,
+			wall.type, wall.flags, wall.tag,
+			sideIndex(wall.frontSide), sideIndex(wall.backSide),
+			0,
+		});
+	}
+	std::vector<SegmentRecord> segmentRecords;
+	std::unordered_map<const Segment*, int32_t> segmentIndices;
+	for (const auto& segment : segs) {
+		segmentIndices[segment.get()] = static_cast<int32_t>(segmentRecords.size());
+		segmentRecords.push_back({
+			segment->s.x, segment->s.y, segment->e.x, segment->e.y,
+			segment->type, segment->flags, segment->tag,
+			sideIndex(segment->frontSide), sideIndex(segment->backSide),
+			segment->xOffset,
+		});
+	}
+	std::vector<SubSectorRecord> subsectorRecords;
+	for (const auto& subsector : subsectors) {
+		const auto& segments = subsector->segments;
+		subsectorRecords.push_back({
+			segments.empty() ? 0 : segmentIndices[segments.front().get()],
+			static_cast<int32_t>(segments.size()),
+		});
+	}
+	std::vector<NodeRecord> nodeRecords;
+	for (const auto& node : nodes)
+		nodeRecords.push_back({ node.x, node.y, node.dx, node.dy, node.rightChild, node.leftChild });
+	std::vector<ThingRecord> thingRecords;
+	for (const auto& thing : things)
+		thingRecords.push_back({ thing.x, thing.y, thing.angle, static_cast<int32_t>(thing.type), 0 });
+
+	Header header {};
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.contentHash = wad.GetContentHash();
+	std::strncpy(header.name, name.c_str(), sizeof(header.name));
+	header.flatCount = flatNames.names.size();
+	header.textureCount = textureNames.names.size();
+	header.sectorCount = sectorRecords.size();
+	header.sideCount = sideRecords.size();
+	header.wallCount = wallRecords.size();
+	header.segCount = segmentRecords.size();
+	header.subsectorCount = subsectorRecords.size();
+	header.nodeCount = nodeRecords.size();
+	header.thingCount = thingRecords.size();
+	header.flags = builtNodes ? BUILT_NODES : 0;
+
+	// Write next to the final path and rename, so readers never see a partial file
+	mkdir(settings::CACHE_DIRECTORY, 0755);
+	const auto path = CachePath(name, wad.GetContentHash());
+	// The temporary name is unique, so loaders of the same map racing to
+	// store it each publish a whole file and the last rename wins
+	auto temporaryPath = path + ".XXXXXX";
+	const auto fd = mkstemp(temporaryPath.data());
+	if (fd < 0) {
+		std::cerr << "[WARN]: Could not write map cache '" << path << "'" << std::endl;
+		return;
+	}
+	fchmod(fd, 0644);
+	close(fd);
+	std::ofstream file(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cerr << "[WARN]: Could not write map cache '" << path << "'" << std::endl;
+		std::remove(temporaryPath.c_str());
+		return;
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	Write(file, flatNames.names);
+	Write(file, textureNames.names);
+	Write(file, sectorRecords);
+	Write(file, sideRecords);
+	Write(file, wallRecords);
+	Write(file, segmentRecords);
+	Write(file, subsectorRecords);
+	Write(file, nodeRecords);
+	Write(file, thingRecords);
+	file.close();
+	if (!file || std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+		std::cerr << "[WARN]: Could not write map cache '" << path << "'" << std::endl;
+		std::remove(temporaryPath.c_str());
+	}
+}
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include "nodebuilder.h"
+
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+NodeBuilder::NodeBuilder(const std::vector<Wall>& walls): walls { walls } {
+}
+
+void NodeBuilder::Build(MapGeometry& map) {
+	map.segs.clear();
+	map.subsectors.clear();
+	map.nodes.clear();
+	statistics = {};
+	leafDepthSum = 0;
+
+	std::vector<Seg> segs;
+	for (size_t i = 0; i < walls.size(); i++) {
+		const auto& wall = walls[i];
+		if (wall.frontSide == nullptr || (wall.s.x == wall.e.x && wall.s.y == wall.e.y))
+			continue;
+		segs.push_back({ wall.s, wall.e, static_cast<int>(i), false, 0 });
+		if (wall.backSide != nullptr)
+			segs.push_back({ wall.e, wall.s, static_cast<int>(i), true, 0 });
+	}
+	// Traversal starts at the last node, so there must be at least one
+	if (segs.empty()) {
+		std::cerr << "Error: no lines with a front side to build nodes from" << std::endl;
+		exit(1);
+	}
+
+	const auto root = BuildNode(map, segs, 0);
+
+	// Traversal starts at the last node, so a single-leaf map still needs one
+	if (root & Node::SUBSECTOR) {
+		const auto& seg = map.segs.front();
+		map.nodes.push_back({ seg->s.x, seg->s.y, seg->e.x - seg->s.x, seg->e.y - seg->s.y, root, root });
+	}
+
+	statistics.segs = map.segs.size();
+	statistics.subsectors = map.subsectors.size();
+	statistics.nodes = map.nodes.size();
+	statistics.averageDepth = static_cast<double>(leafDepthSum) / statistics.subsectors;
+}
+
+void NodeBuilder::Report(std::ostream& out, const std::string& name) const {
+	out << "[INFO]: Built nodes for " << name << ": "
+		<< statistics.nodes << " nodes, "
+		<< statistics.subsectors << " subsectors, "
+		<< statistics.segs << " segs (" << statistics.splits << " splits), "
+		<< "depth " << statistics.maxDepth << " max, " << statistics.averageDepth << " average";
+	if (statistics.nonConvex > 0)
+		out << ", " << statistics.nonConvex << " non-convex subsectors";
+	out << std::endl;
+}
+
+uint32_t NodeBuilder::BuildNode(MapGeometry& map, std::vector<Seg>& segs, int depth) {
+	if (IsConvex(segs))
+		return BuildSubSector(map, segs, depth);
+
+	// Evaluate an evenly spread sample of the segs as partition candidates,
+	// then all of them if the sample has none that divides the set
+	const auto stride = std::max<size_t>(1, segs.size() / MAX_CANDIDATES);
+	auto partition = FindPartition(segs, stride);
+	if (partition == nullptr && stride > 1)
+		partition = FindPartition(segs, 1);
+	if (partition == nullptr) {
+		std::cerr << "[WARN]: No partition divides " << segs.size() << " segs, building a non-convex subsector" << std::endl;
+		statistics.nonConvex++;
+		return BuildSubSector(map, segs, depth);
+	}
+
+	const auto p = *partition;
+	std::vector<Seg> right, left;
+	for (const auto& seg : segs) {
+		double ds, de;
+		switch (Classify(p, seg, ds, de)) {
+		case Side::Right:
+			right.push_back(seg);
+			break;
+		case Side::Left:
+			left.push_back(seg);
+			break;
+		case Side::Split: {
+			const auto t = ds / (ds - de);
+			const Point m { seg.s.x + t * (seg.e.x - seg.s.x), seg.s.y + t * (seg.e.y - seg.s.y) };
+			const auto length = std::hypot(m.x - seg.s.x, m.y - seg.s.y);
+			const Seg head { seg.s, m, seg.wall, seg.opposite, seg.offset };
+			const Seg tail { m, seg.e, seg.wall, seg.opposite, seg.offset + length };
+			(ds > 0 ? right : left).push_back(head);
+			(de > 0 ? right : left).push_back(tail);
+			statistics.splits++;
+			break;
+		}
+		}
+	}
+	segs.clear();
+	segs.shrink_to_fit();
+
+	const auto rightChild = BuildNode(map, right, depth + 1);
+	const auto leftChild = BuildNode(map, left, depth + 1);
+	map.nodes.push_back({ p.s.x, p.s.y, p.e.x - p.s.x, p.e.y - p.s.y, rightChild, leftChild });
+	return static_cast<uint32_t>(map.nodes.size() - 1);
+}
+
+const NodeBuilder::Seg* NodeBuilder::FindPartition(const std::vector<Seg>& segs, size_t stride) const {
+	const Seg* partition = nullptr;
+	auto bestCost = INT_MAX;
+	for (size_t i = 0; i < segs.size(); i += stride) {
+		const auto cost = Cost(segs[i], segs, bestCost);
+		if (cost < bestCost) {
+			bestCost = cost;
+			partition = &segs[i];
+		}
+	}
+	return partition;
+}
+
+uint32_t NodeBuilder::BuildSubSector(MapGeometry& map, const std::vector<Seg>& segs, int depth) {
+	std::vector<std::shared_ptr<Segment>> segments;
+	for (const auto& seg : segs) {
+		segments.push_back(std::make_shared<Segment>(Segment {
+			Vertex { seg.s.x, seg.s.y },
+			Vertex { seg.e.x, seg.e.y },
+			walls[seg.wall],
+			seg.opposite,
+			static_cast<int>(std::lround(seg.offset)),
+		}));
+		map.segs.push_back(segments.back());
+	}
+	map.subsectors.push_back(std::make_shared<SubSector>(SubSector { segments }));
+
+	statistics.maxDepth = std::max(statistics.maxDepth, depth);
+	leafDepthSum += depth;
+	return static_cast<uint32_t>(Node::SUBSECTOR | (map.subsectors.size() - 1));
+}
+
+// Signed distance from the seg's line, positive on its right (front) side
+double NodeBuilder::Distance(const Seg& seg, const Point& point) {
+	const auto dx = seg.e.x - seg.s.x;
+	const auto dy = seg.e.y - seg.s.y;
+	return ((point.x - seg.s.x) * dy - (point.y - seg.s.y) * dx) / std::hypot(dx, dy);
+}
+
+NodeBuilder::Side NodeBuilder::Classify(const Seg& partition, const Seg& seg, double& ds, double& de) {
+	ds = Distance(partition, seg.s);
+	de = Distance(partition, seg.e);
+	if (std::abs(ds) < EPSILON)
+		ds = 0;
+	if (std::abs(de) < EPSILON)
+		de = 0;
+	if (ds == 0 && de == 0) {
+		const auto dot = (seg.e.x - seg.s.x) * (partition.e.x - partition.s.x) + (seg.e.y - seg.s.y) * (partition.e.y - partition.s.y);
+		return dot > 0 ? Side::Right : Side::Left;
+	}
+	if (ds >= 0 && de >= 0)
+		return Side::Right;
+	if (ds <= 0 && de <= 0)
+		return Side::Left;
+	return Side::Split;
+}
+
+// Convex when no seg lies behind another, including both sides of one line
+bool NodeBuilder::IsConvex(const std::vector<Seg>& segs) {
+	for (const auto& partition : segs) {
+		for (const auto& seg : segs) {
+			double ds, de;
+			if (Classify(partition, seg, ds, de) != Side::Right)
+				return false;
+		}
+	}
+	return true;
+}
+
+int NodeBuilder::Cost(const Seg& partition, const std::vector<Seg>& segs, int bestCost) const {
+	int right = 0, left = 0, splits = 0;
+	for (const auto& seg : segs) {
+		double ds, de;
+		switch (Classify(partition, seg, ds, de)) {
+		case Side::Right: right++; break;
+		case Side::Left: left++; break;
+		case Side::Split: splits++; right++; left++; break;
+		}
+		if (splits * SPLIT_COST > bestCost)
+			return INT_MAX;
+	}
+	if (right == 0 || left == 0)
+		return INT_MAX;
+	return splits * SPLIT_COST + std::abs(right - left);
+}
\ No newline at end of file
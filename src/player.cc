@@ -4,7 +4,11 @@
 #include <iostream>
 
 Player::Player(Map& map): Location {0, 0, 0}, map {map} {
-	for (const auto& t : map.things) {
+	Respawn();
+}
+
+void Player::Respawn() {
+	for (const auto& t : map.geometry->things) {
 		if (t.type == Thing::Type::PLAYER_1_START) {
 			x = t.x;
 			y = t.y;
@@ -14,6 +18,21 @@ Player::Player(Map& map): Location {0, 0, 0}, map {map} {
 	}
 }
 
+void Player::Apply(const TicCommand& command) {
+	forward = (command.buttons & TicCommand::FORWARD) != 0;
+	backward = (command.buttons & TicCommand::BACKWARD) != 0;
+	strafeLeft = (command.buttons & TicCommand::STRAFE_LEFT) != 0;
+	strafeRight = (command.buttons & TicCommand::STRAFE_RIGHT) != 0;
+	turnLeft = (command.buttons & TicCommand::TURN_LEFT) != 0;
+	turnRight = (command.buttons & TicCommand::TURN_RIGHT) != 0;
+
+	angle -= command.mouseX * mouseSpeed;
+	if (angle < 0)
+		angle += 2 * M_PI;
+	if (angle >= 2 * M_PI)
+		angle -= 2 * M_PI;
+}
+
 double Dot(double ax, double ay, double bx, double by) {
 	return ax * bx + ay * by;
 }
@@ -39,8 +58,9 @@ double DistToLinedef(double cx, double cy, const Segment& linedef) {
 }
 
 void Player::Update() {
+	arena.Reset();
 	auto currentSubsector = GetCurrentSubsector();
-	auto currentSector = currentSubsector->segments.front()->frontSide->sector;
+	auto currentSector = &map.GetSector(*currentSubsector->segments.front()->frontSide);
 
 	if (turnLeft) {
 		if ((angle += turnSpeed * M_PI) > M_PI)
@@ -70,22 +90,19 @@ void Player::Update() {
 		vy -= walkSpeed * c;
 	}
 
-	for (const auto& linedef : map.GetOrderedSegments(*this)) {
+	for (const auto& linedef : map.GetOrderedSegments(*this, &arena)) {
 		if (DistToLinedef(x + vx, y + vy, *linedef) < 8 * 8) {
 			double heightChange = 0;
 			double targetHeight = 0;
 			if (linedef->twoSided) {
-				if (linedef->frontSide->sector == currentSector) {
-					heightChange = linedef->backSide->sector->floorHeight - currentSector->floorHeight;
-					targetHeight = linedef->backSide->sector->ceilingHeight - linedef->backSide->sector->floorHeight;
-				} else {
-					heightChange = linedef->frontSide->sector->floorHeight - currentSector->floorHeight;
-					targetHeight = linedef->frontSide->sector->ceilingHeight - linedef->frontSide->sector->floorHeight;
-				}
+				const auto& frontSector = map.GetSector(*linedef->frontSide);
+				const auto& backSector = map.GetSector(*linedef->backSide);
+				const auto& otherSector = &frontSector == currentSector ? backSector : frontSector;
+				heightChange = otherSector.floorHeight - currentSector->floorHeight;
+				targetHeight = otherSector.ceilingHeight - otherSector.floorHeight;
 			}
 			if (!linedef->twoSided || heightChange > 24 || targetHeight < 56) {
-				if (linedef->type >= 1 && linedef->type <= 4 && linedef->twoSided)
-					linedef->backSide->sector->Trigger();
+				map.Activate(*linedef);
 				double dx = linedef->e.x - linedef->s.x;
 				double dy = linedef->e.y - linedef->s.y;
 				double det = (vx * dx + dy * vy) / (dx * dx + dy * dy);
@@ -101,8 +118,9 @@ void Player::Update() {
 }
 
 std::shared_ptr<SubSector> Player::GetCurrentSubsector() const {
-	int node = map.nodes.size() - 1;
-	while ((node & 0x8000) == 0)
-		node = Map::IsInFrontOf(*this, map.nodes[node]) ? map.nodes[node].rightChild : map.nodes[node].leftChild;
-	return map.subsectors[node & 0x7fff];
+	const auto& nodes = map.geometry->nodes;
+	uint32_t node = nodes.size() - 1;
+	while ((node & Node::SUBSECTOR) == 0)
+		node = Map::IsInFrontOf(*this, nodes[node]) ? nodes[node].rightChild : nodes[node].leftChild;
+	return map.geometry->subsectors[node & ~Node::SUBSECTOR];
 };
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "presenter.h"
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "settings.h"
+
+/*
+ * Upscaling
+ */
+static void UpscaleRow(const uint32_t* source, int width, uint32_t* destination, int scale) {
+	auto x = 0;
+#ifdef __SSE2__
+	if (scale == 2) {
+		for (; x + 4 <= width; x += 4) {
+			const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x * 2), _mm_unpacklo_epi32(v, v));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x * 2 + 4), _mm_unpackhi_epi32(v, v));
+		}
+	} else if (scale == 3) {
+		for (; x + 4 <= width; x += 4) {
+			const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x * 3), _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 0, 0)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x * 3 + 4), _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 1, 1)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x * 3 + 8), _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 2)));
+		}
+	}
+#elif defined(__ARM_NEON)
+	// Interleaving stores of the same vector repeat each lane
+	if (scale == 2) {
+		for (; x + 4 <= width; x += 4) {
+			const auto v = vld1q_u32(source + x);
+			vst2q_u32(destination + x * 2, (uint32x4x2_t { { v, v } }));
+		}
+	} else if (scale == 3) {
+		for (; x + 4 <= width; x += 4) {
+			const auto v = vld1q_u32(source + x);
+			vst3q_u32(destination + x * 3, (uint32x4x3_t { { v, v, v } }));
+		}
+	}
+#endif
+	for (; x < width; x++) {
+		for (auto i = 0; i < scale; i++)
+			destination[x * scale + i] = source[x];
+	}
+}
+
+void Upscale(const uint32_t* source, int width, int height, uint32_t* destination, size_t pitch, int scale) {
+	const auto rowBytes = width * scale * sizeof(uint32_t);
+	for (auto y = 0; y < height; y++) {
+		auto row = destination + y * scale * pitch;
+		UpscaleRow(source + y * width, width, row, scale);
+		// The other rows are copies of the first
+		for (auto i = 1; i < scale; i++)
+			std::memcpy(row + i * pitch, row, rowBytes);
+	}
+}
+
+/*
+ * Presenter
+ */
+Presenter::Presenter(SDL_Window* window, bool threaded): window { window }, windowSurface { SDL_GetWindowSurface(window) } {
+	const auto format = windowSurface->format->format;
+	direct = (format == SDL_PIXELFORMAT_RGB888 || format == SDL_PIXELFORMAT_ARGB8888)
+		&& windowSurface->w >= settings::WIDTH * settings::SCALE && windowSurface->h >= settings::HEIGHT * settings::SCALE
+		&& windowSurface->pitch % sizeof(uint32_t) == 0;
+	if (threaded)
+		thread = std::thread { &Presenter::Run, this };
+}
+
+Presenter::~Presenter() {
+	if (!IsThreaded())
+		return;
+	{
+		std::lock_guard lock { mutex };
+		quit = true;
+	}
+	changed.notify_all();
+	thread.join();
+}
+
+void Presenter::Present(SDL_Surface* screen) {
+	if (!IsThreaded()) {
+		Scale(screen);
+		SDL_UpdateWindowSurface(window);
+		return;
+	}
+
+	// Show the frame scaled since the last call, then hand over this one
+	std::unique_lock lock { mutex };
+	changed.wait(lock, [&] { return pending == nullptr; });
+	if (scaled)
+		SDL_UpdateWindowSurface(window);
+	pending = screen;
+	lock.unlock();
+	changed.notify_all();
+}
+
+void Presenter::Scale(SDL_Surface* screen) {
+	if (!direct) {
+		auto screenRect = SDL_Rect { 0, 0, settings::WIDTH, settings::HEIGHT };
+		auto windowSurfaceRect = SDL_Rect { 0, 0, settings::WIDTH * settings::SCALE, settings::HEIGHT * settings::SCALE };
+		SDL_BlitScaled(screen, &screenRect, windowSurface, &windowSurfaceRect);
+		return;
+	}
+	SDL_LockSurface(screen);
+	SDL_LockSurface(windowSurface);
+	Upscale(static_cast<const uint32_t*>(screen->pixels), settings::WIDTH, settings::HEIGHT,
+		static_cast<uint32_t*>(windowSurface->pixels), windowSurface->pitch / sizeof(uint32_t), settings::SCALE);
+	SDL_UnlockSurface(windowSurface);
+	SDL_UnlockSurface(screen);
+}
+
+void Presenter::Run() {
+	std::unique_lock lock { mutex };
+	while (true) {
+		changed.wait(lock, [&] { return pending != nullptr || quit; });
+		if (pending == nullptr)
+			break;
+		const auto screen = pending;
+		lock.unlock();
+		Scale(screen);
+		lock.lock();
+		pending = nullptr;
+		scaled = true;
+		changed.notify_all();
+	}
+}
\ No newline at end of file
@@ -7,29 +7,26 @@
 #include <memory>
 #include <utility>
 
+#include "allocations.h"
+
 Renderer::Renderer(WAD& wad, Map& map, Player& player, uint32_t* pixels): wad { wad }, map { map }, player { player }, pixels { pixels } {
-	wad.seek(wad.GetLump("PLAYPAL")->location);
+	const auto playpal = wad.GetLumpData(*wad.GetLump("PLAYPAL"));
 	for (auto i = 0; i < Palette::SIZE; i++) {
-		palette.colors[i].r = wad.read<uint8_t>();
-		palette.colors[i].g = wad.read<uint8_t>();
-		palette.colors[i].b = wad.read<uint8_t>();
+		palette.colors[i].r = playpal.data[i * 3];
+		palette.colors[i].g = playpal.data[i * 3 + 1];
+		palette.colors[i].b = playpal.data[i * 3 + 2];
 	}
+	sky = wad.GetTexture("SKY1");
 }
 
 void Renderer::Render() {
-	horizontalOcclusion.clear();
-	ceilingPlanes.clear();
-	floorPlanes.clear();
-	for (int x = 0; x < settings::WIDTH; x++) {
-		ceilingClip[x] = 0;
-		floorClip[x] = settings::HEIGHT;
-	}
-
-	for (const auto& segment : map.GetOrderedSegments(player))
+	allocations::Scope scope { allocations::Phase::RENDER };
+	BeginFrame();
+	for (const auto segment : map.GetOrderedSegments(player, &arena))
 		RenderSegment(*segment);
-	for (const auto& plane : ceilingPlanes)
+	for (const auto& plane : frame->ceilingPlanes)
 		RenderPlane(plane);
-	for (const auto& plane : floorPlanes)
+	for (const auto& plane : frame->floorPlanes)
 		RenderPlane(plane);
 }
 
@@ -71,7 +68,7 @@ void Renderer::RenderSegment(const Segment& segment) {
 
 void Renderer::RenderSegmentSpan(const Span& span, const VisibleSegment& vs) {
 	const auto& segment = vs.segment;
-	const auto& frontSector = segment.frontSide->sector;
+	const auto frontSector = &map.GetSector(*segment.frontSide);
 
 	for (auto x = span.s; x < span.e; x++) {
 		if (ceilingClip[x] >= floorClip[x])
@@ -104,7 +101,7 @@ void Renderer::RenderSegmentSpan(const Span& span, const VisibleSegment& vs) {
 		};
 
 		if (segment.twoSided) {
-			const auto& backSector = segment.backSide->sector;
+			const auto backSector = &map.GetSector(*segment.backSide);
 			const auto isSky = frontSector->isSky && backSector->isSky;
 
             const auto innerTopY = ViewY(projectionDistance, backSector->ceilingHeight - player.z);
@@ -130,6 +127,17 @@ void Renderer::RenderSegmentSpan(const Span& span, const VisibleSegment& vs) {
 	}
 }
 
+void Renderer::BeginFrame() {
+	// The last frame's containers go before the memory under them is reused
+	frame.reset();
+	arena.Reset();
+	frame.emplace(&arena);
+	for (int x = 0; x < settings::WIDTH; x++) {
+		ceilingClip[x] = 0;
+		floorClip[x] = settings::HEIGHT;
+	}
+}
+
 void Renderer::RenderWallSlice(const WallSlice& ws) {
 	if (ws.texture == nullptr)
 		return;
@@ -145,7 +153,7 @@ void Renderer::RenderWallSlice(const WallSlice& ws) {
 }
 
 void Renderer::RenderPlane(const Plane& plane) {
-	std::shared_ptr<Texture> texture = plane.isSky ? wad.GetTexture("SKY1") : plane.texture;
+	const auto texture = plane.isSky ? sky.get() : plane.texture;
 
 	const auto angle = NormalizeAngle(player.angle);
 	const auto angleStep = M_PI_4 / (settings::WIDTH / 2);
@@ -157,7 +165,7 @@ void Renderer::RenderPlane(const Plane& plane) {
 		if (spans.empty())
 			continue;
 
-		std::list<Span> mergedSpans(spans.begin(), spans.end());
+		std::pmr::list<Span> mergedSpans(spans.begin(), spans.end(), &arena);
 		mergedSpans.sort();
 		auto es = mergedSpans.begin();
 		do {
@@ -211,8 +219,9 @@ void Renderer::RenderPlane(const Plane& plane) {
 	}
 }
 
-std::vector<Span> Renderer::ClipHorizontal(int startX, int endX, bool solid) {
-	std::vector<Span> visible;
+std::pmr::vector<Span> Renderer::ClipHorizontal(int startX, int endX, bool solid) {
+	std::pmr::vector<Span> visible { &arena };
+	auto& horizontalOcclusion = frame->horizontalOcclusion;
 
 	startX = std::clamp(startX, 0, settings::WIDTH);
 	endX = std::clamp(endX, 0, settings::WIDTH);
@@ -285,14 +294,14 @@ Span Renderer::ClipVertical(int x, int sy, int ey, bool solid, const Sector& sec
 	if (sy > ceilingClip[x]) {
 		span.s = std::min(sy, floorClip[x]);
 		if (ceilingHeight != nullptr)
-			ClipPlane(ceilingPlanes, x, ceilingClip[x], span.s, *ceilingHeight, sector.lightLevel, sector.ceilingTexture);
+			ClipPlane(frame->ceilingPlanes, x, ceilingClip[x], span.s, *ceilingHeight, sector.lightLevel, sector.ceilingTexture);
 	} else {
 		span.s = ceilingClip[x];
 	}
 	if (ey < floorClip[x]) {
 		span.e = std::max(ey, ceilingClip[x]);
 		if (floorHeight != nullptr)
-			ClipPlane(floorPlanes, x, span.e, floorClip[x], *floorHeight, sector.lightLevel, sector.floorTexture);
+			ClipPlane(frame->floorPlanes, x, span.e, floorClip[x], *floorHeight, sector.lightLevel, sector.floorTexture);
 	} else {
 		span.e = floorClip[x];
 	}
@@ -309,12 +318,12 @@ Span Renderer::ClipVertical(int x, int sy, int ey, bool solid, const Sector& sec
 	return span;
 }
 
-void Renderer::ClipPlane(std::deque<Plane>& planes, int x, int sy, int ey, double height, double light, std::shared_ptr<Texture> texture) {
+void Renderer::ClipPlane(std::pmr::deque<Plane>& planes, int x, int sy, int ey, double height, double light, const Texture* texture) {
 	auto plane = std::find_if(planes.begin(), planes.end(), [&](const Plane& plane) {
 		return (plane.height == height || (!std::isfinite(plane.height) && !std::isfinite(height))) && plane.light == light && plane.texture == texture;
 	});
 	if (plane == planes.end()) {
-		planes.push_front(Plane {height, light, texture, settings::HEIGHT});
+		planes.emplace_front(height, light, texture, settings::HEIGHT, &arena);
 		plane = planes.begin();
 	}
 	for (auto y = sy; y < ey; y++) {
@@ -335,20 +344,13 @@ void Renderer::ClipPlane(std::deque<Plane>& planes, int x, int sy, int ey, doubl
 /*
  * Helpers
  */
-std::tuple<Vector, double> Renderer::CalculateNormal(const Line& l) {
-	auto lineAngle = std::atan2(l.e.y - l.s.y, l.e.x - l.s.x);
-	auto normalAngle = lineAngle + M_PI_2;
-	auto sx = l.s.x - player.x;
-	auto sy = l.s.y - player.y;
-	auto dx = player.x - l.s.x;
-	auto dy = player.y - l.s.y;
-	auto startDistance = std::sqrt(dx * dx + dy * dy);
-	auto startAngle = atan2(sy, sx);
-	auto normalDistance = std::abs(startDistance * std::cos(normalAngle - startAngle));
-	auto normalOffset = std::abs(startDistance * std::sin(normalAngle - startAngle));
-	if (NormalizeAngle(normalAngle - startAngle) > 0)
-		normalOffset *= -1;
-	return std::tuple<Vector, double> { Vector {normalAngle, normalDistance}, normalOffset };
+std::tuple<Vector, double> Renderer::CalculateNormal(const Segment& segment) {
+	// Project the player onto the segment's precomputed direction and normal
+	const auto dx = player.x - segment.s.x;
+	const auto dy = player.y - segment.s.y;
+	const auto normalDistance = std::abs(dy * segment.direction.x - dx * segment.direction.y);
+	const auto normalOffset = dx * segment.direction.x + dy * segment.direction.y;
+	return std::tuple<Vector, double> { Vector {segment.normalAngle, normalDistance}, normalOffset };
 }
 
 double Renderer::NormalizeAngle(double angle) {
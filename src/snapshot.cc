@@ -0,0 +1,121 @@
+#include "snapshot.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace {
+	constexpr uint32_t MAGIC = 0x504e5344; // "DSNP"
+
+	struct Header {
+		uint32_t magic;
+		// The map the snapshot was taken on
+		uint64_t wadHash;
+		char map[8];
+		uint32_t sectorCount;
+		uint32_t changedCount;
+		uint8_t buttons;
+		double x, y, z, angle;
+	} __attribute__((packed));
+
+	// Sector flags
+	constexpr uint8_t OPEN = 1 << 0;
+	constexpr uint8_t CLOSE = 1 << 1;
+
+	struct SectorRecord {
+		uint32_t index;
+		double ceilingHeight, floorHeight;
+		int32_t timer;
+		uint8_t flags;
+	} __attribute__((packed));
+
+	uint8_t Buttons(const Player& player) {
+		return (player.forward ? TicCommand::FORWARD : 0)
+			| (player.backward ? TicCommand::BACKWARD : 0)
+			| (player.strafeLeft ? TicCommand::STRAFE_LEFT : 0)
+			| (player.strafeRight ? TicCommand::STRAFE_RIGHT : 0)
+			| (player.turnLeft ? TicCommand::TURN_LEFT : 0)
+			| (player.turnRight ? TicCommand::TURN_RIGHT : 0);
+	}
+}
+
+void SaveSnapshot(const Map& map, const Player& player, std::vector<uint8_t>& buffer) {
+	buffer.resize(sizeof(Header));
+	uint32_t changedCount = 0;
+	for (uint32_t i = 0; i < map.sectors.size(); i++) {
+		const auto& sector = map.sectors[i];
+		if (sector.ceilingHeight == sector.initialCeilingHeight && sector.floorHeight == sector.initialFloorHeight
+				&& sector.timer == 0 && !sector.open && !sector.close)
+			continue;
+		const SectorRecord record {
+			i,
+			sector.ceilingHeight, sector.floorHeight,
+			sector.timer,
+			static_cast<uint8_t>((sector.open ? OPEN : 0) | (sector.close ? CLOSE : 0)),
+		};
+		const auto bytes = reinterpret_cast<const uint8_t*>(&record);
+		buffer.insert(buffer.end(), bytes, bytes + sizeof(record));
+		changedCount++;
+	}
+
+	Header header {
+		MAGIC,
+		map.geometry->wadHash,
+		{},
+		static_cast<uint32_t>(map.sectors.size()),
+		changedCount,
+		Buttons(player),
+		player.x, player.y, player.z, player.angle,
+	};
+	std::strncpy(header.map, map.geometry->name.c_str(), sizeof(header.map));
+	std::memcpy(buffer.data(), &header, sizeof(header));
+}
+
+bool RestoreSnapshot(Map& map, Player& player, const std::vector<uint8_t>& buffer) {
+	Header header;
+	if (buffer.size() < sizeof(header))
+		return false;
+	std::memcpy(&header, buffer.data(), sizeof(header));
+	if (header.magic != MAGIC || header.wadHash != map.geometry->wadHash
+			|| map.geometry->name != std::string(header.map, strnlen(header.map, sizeof(header.map)))
+			|| header.sectorCount != map.sectors.size()
+			|| buffer.size() != sizeof(header) + header.changedCount * sizeof(SectorRecord)) {
+		std::cerr << "[WARN]: Snapshot does not belong to this map" << std::endl;
+		return false;
+	}
+	std::vector<SectorRecord> records(header.changedCount);
+	std::memcpy(records.data(), buffer.data() + sizeof(header), records.size() * sizeof(SectorRecord));
+	for (const auto& record : records) {
+		if (record.index >= map.sectors.size())
+			return false;
+	}
+
+	for (auto& sector : map.sectors) {
+		sector.ceilingHeight = sector.initialCeilingHeight;
+		sector.floorHeight = sector.initialFloorHeight;
+		sector.timer = 0;
+		sector.open = false;
+		sector.close = false;
+	}
+	for (const auto& record : records) {
+		auto& sector = map.sectors[record.index];
+		sector.ceilingHeight = record.ceilingHeight;
+		sector.floorHeight = record.floorHeight;
+		sector.timer = record.timer;
+		sector.open = (record.flags & OPEN) != 0;
+		sector.close = (record.flags & CLOSE) != 0;
+	}
+
+	// Moving sectors are exactly those opening or closing
+	map.activeSectors.clear();
+	for (auto& sector : map.sectors) {
+		if (sector.open || sector.close)
+			map.activeSectors.push_back(&sector);
+	}
+
+	player.Apply(TicCommand { header.buttons, 0 });
+	player.x = header.x;
+	player.y = header.y;
+	player.z = header.z;
+	player.angle = header.angle;
+	return true;
+}
\ No newline at end of file
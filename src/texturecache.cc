@@ -0,0 +1,43 @@
+#include "texturecache.h"
+
+#include "wad.h"
+
+std::shared_ptr<Texture> TextureCache::Get(Kind kind, uint64_t key, const Loader& load) {
+	// Recursive, since composing a texture fetches its patches
+	std::lock_guard<std::recursive_mutex> lock { mutex };
+
+	auto& table = entries[static_cast<size_t>(kind)];
+	auto it = table.find(key);
+	if (it != table.end()) {
+		order.splice(order.begin(), order, it->second.position);
+		return it->second.texture;
+	}
+
+	auto texture = load();
+	if (texture == nullptr)
+		return nullptr;
+	order.emplace_front(kind, key);
+	const auto textureSize = SizeOf(*texture);
+	table.emplace(key, Entry { texture, textureSize, order.begin() });
+	size += textureSize;
+	Evict();
+	return texture;
+}
+
+size_t TextureCache::SizeOf(const Texture& texture) {
+	return sizeof(Texture) + static_cast<size_t>(texture.width) * texture.height;
+}
+
+void TextureCache::Evict() {
+	auto it = order.end();
+	while (size > limit && it != order.begin()) {
+		--it;
+		auto& table = entries[static_cast<size_t>(it->first)];
+		auto entry = table.find(it->second);
+		if (entry->second.texture.use_count() > 1)
+			continue;
+		size -= entry->second.size;
+		table.erase(entry);
+		it = order.erase(it);
+	}
+}
\ No newline at end of file
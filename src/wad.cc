@@ -1,19 +1,37 @@
 #include "wad.h"
 
+#include "allocations.h"
+#include "parallel.h"
+#include "settings.h"
+
 #include <algorithm>
-#include <fstream>
+#include <chrono>
+#include <fcntl.h>
 #include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /*
  * Lump
  */
+// Matches X_START/X_END and the XX_ and X1_ style variants used by PWADs
+static bool IsNamespaceMarker(const std::string& name, char prefix) {
+	if (name.empty() || name[0] != prefix)
+		return false;
+	auto suffix = name.substr(1);
+	if (!suffix.empty() && (suffix[0] == prefix || isdigit(suffix[0])))
+		suffix = suffix.substr(1);
+	return suffix == "_START" || suffix == "_END";
+}
+
 WAD::Lump::Type WAD::Lump::StringToType(const std::string& name) {
 	if (name[0] == 'E' && name[2] == 'M')
 		return Type::MapMarker;
-	if (name[0] == 'P' && isdigit(name[1]) && name[2] == '_')
-		return name[3] == 'S' ? Type::PatchesStart : Type::PatchesEnd;
-	if (name[0] == 'F' && isdigit(name[1]) && name[2] == '_')
-		return name[3] == 'S' ? Type::FlatsStart : Type::FlatsEnd;
+	if (IsNamespaceMarker(name, 'P'))
+		return name.back() == 'T' ? Type::PatchesStart : Type::PatchesEnd;
+	if (IsNamespaceMarker(name, 'F'))
+		return name.back() == 'T' ? Type::FlatsStart : Type::FlatsEnd;
 	if (name[0] == 'S' && name[1] == '_')
 		return name[3] == 'S' ? Type::SpritesStart : Type::SpritesEnd;
 	if (name == "PLAYPAL")
@@ -25,197 +43,372 @@ WAD::Lump::Type WAD::Lump::StringToType(const std::string& name) {
 	return Type::Unknown;
 }
 
-WAD::Lump::Lump(uint32_t location, uint32_t size, std::string name): location {location}, size { size }, name { name }, type { StringToType(name) } {
+WAD::Lump::Lump(size_t file, const uint8_t* data, uint32_t location, uint32_t size, std::string name): file { file }, data { data }, location {location}, size { size }, name { name }, type { StringToType(name) } {
 }
 
 /*
  * WAD
  */
-WAD::WAD(const std::string& filename) {
-	file = std::ifstream(filename, std::ios::in | std::ios::binary);
-	if (!file.is_open()) {
-		std::cerr << "Error: could not open WAD '" << filename << "'" << std::endl;
-		exit(1);
+static double SecondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static uint64_t Fnv1a(uint64_t hash, const void* data, size_t size) {
+	const auto bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3;
 	}
+	return hash;
+}
 
-	auto type = readString(4);
-	if (type != "IWAD") {
-		std::cerr << "Error: unsupported WAD type '" << type << "'" << std::endl;
-		exit(1);
+// Hashes a word at a time; fast enough to run over whole WAD files at startup
+static uint64_t HashWords(uint64_t hash, const uint8_t* data, size_t size) {
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		std::memcpy(&word, data + i, sizeof(word));
+		hash = (hash ^ word) * 0x100000001b3;
+		hash ^= hash >> 29;
 	}
-	auto lumpCount = read<uint32_t>();
-	auto directoryLocation = read<uint32_t>();
-	seek(directoryLocation);
-	for (uint32_t i = 0; i < lumpCount; i++) {
-		auto location = read<uint32_t>();
-		auto size = read<uint32_t>();
-		auto name = readString(8);
-		lumps.push_back(std::make_shared<Lump>(location, size, name));
-	}
-
-	struct Patch {
-		int16_t width;
-		int16_t height;
-		int16_t left;
-		int16_t top;
-		std::unique_ptr<uint8_t[]> pixels;
-	};
-	std::map<std::string, std::shared_ptr<Patch>> patches;
-	std::vector<std::string> patchNames;
+	return Fnv1a(hash, data + i, size - i);
+}
+
+WAD::WAD(const std::string& filename, const std::vector<std::string>& patchFiles): cache { settings::TEXTURE_CACHE_SIZE } {
+	allocations::Scope scope { allocations::Phase::LOAD_WAD };
+	auto start = std::chrono::steady_clock::now();
+	hash = 0xcbf29ce484222325;
+	contentHash = 0xcbf29ce484222325;
+	AddFile(filename, "IWAD");
+	for (const auto& patchFile : patchFiles)
+		AddFile(patchFile, "PWAD");
+	data = files.front().data;
 
-	for (auto it = lumps.begin(); it != lumps.end(); it++) {
-		auto lump = *it;
+	// Later files override earlier ones lump by lump, namespaces included
+	enum class Namespace { None, Flats, Patches } ns = Namespace::None;
+	for (size_t i = 0; i < lumps.size(); i++) {
+		const auto& lump = lumps[i];
+		if (i > 0 && lump->file != lumps[i - 1]->file)
+			ns = Namespace::None;
 		switch (lump->type) {
-		case Lump::Type::PatchNames: {
-			seek(lump->location);
-			auto patchCount = read<int32_t>();
-			for (auto i = 0; i < patchCount; i++) {
-				patchNames.push_back(readString(8));
-			}
+		case Lump::Type::FlatsStart: ns = Namespace::Flats; break;
+		case Lump::Type::PatchesStart: ns = Namespace::Patches; break;
+		case Lump::Type::FlatsEnd:
+		case Lump::Type::PatchesEnd: ns = Namespace::None; break;
+		default:
+			if (ns == Namespace::Flats)
+				flatLumps.Insert(NameKey(lump->name), i, true);
+			else if (ns == Namespace::Patches)
+				patchLumps.Insert(NameKey(lump->name), i, true);
 			break;
 		}
-		case Lump::Type::FlatsStart: {
-			while ((*++it)->type != Lump::Type::FlatsEnd) {
-				seek((*it)->location);
-				auto t = std::make_shared<Texture>((*it)->name, 64, 64);
-				read(t->pixels.get(), 64 * 64);
-				flats.insert(make_pair((*it)->name, t));
-			}
-			break;
+	}
+
+	// Like the lumps themselves, texture lists come from the last file providing
+	// them; lumps are read in place, so every count and offset is checked first
+	if (auto index = lumpIndices.Find(NameKey("PNAMES"))) {
+		const auto names = GetLumpData(*lumps[*index]);
+		const auto patchCount = names.size < 4 ? -1 : names.Get<int32_t>(0);
+		if (patchCount < 0 || 4 + static_cast<size_t>(patchCount) * 8 > names.size) {
+			std::cerr << "Error: truncated PNAMES lump" << std::endl;
+			exit(1);
 		}
-		case Lump::Type::PatchesStart: {
-			while ((*++it)->type != Lump::Type::PatchesEnd) {
-				seek((*it)->location);
-
-				auto p = std::make_shared<Patch>();
-				p->width = read<int16_t>();
-				p->height = read<int16_t>();
-				p->left = read<int16_t>();
-				p->top = read<int16_t>();
-				p->pixels = std::make_unique<uint8_t[]>(p->width * p->height);
-
-				int32_t columnArray[p->width];
-				for (auto i = 0; i < p->width; i++)
-					columnArray[i] = read<int32_t>();
-
-				for (auto i = 0; i < p->width; i++) {
-					seek((*it)->location + columnArray[i]);
-					uint8_t rowStart = 0;
-					while (rowStart != 255) {
-						rowStart = read<uint8_t>();
-						if (rowStart == 255)
-							break;
-						auto pixelCount = read<uint8_t>();
-						read<uint8_t>(); // dummy value
-						for (uint8_t j = 0; j < pixelCount; j++)
-							p->pixels[(j + rowStart) * p->width + i] = read<uint8_t>();
-						read<uint8_t>(); // dummy value
-					}
-				}
-
-				patches.insert(make_pair((*it)->name, p));
+		for (auto j = 0; j < patchCount; j++) {
+			patchNames.push_back(NameKey(names.GetString(4 + j * 8, 8)));
+		}
+	}
+	for (const auto textureLump : { "TEXTURE1", "TEXTURE2" }) {
+		auto index = lumpIndices.Find(NameKey(textureLump));
+		if (index == nullptr)
+			continue;
+		const auto definitions = GetLumpData(*lumps[*index]);
+		const auto textureCount = definitions.size < 4 ? 0 : definitions.Get<uint32_t>(0);
+		if (definitions.size < 4 || 4 + static_cast<size_t>(textureCount) * 4 > definitions.size) {
+			std::cerr << "Error: truncated " << textureLump << " lump" << std::endl;
+			exit(1);
+		}
+		for (unsigned j = 0; j < textureCount; j++) {
+			// A definition is a 22 byte header, then 10 bytes per patch
+			const auto offset = definitions.Get<int32_t>(4 + j * 4);
+			if (offset < 0 || static_cast<size_t>(offset) + 22 > definitions.size
+					|| static_cast<size_t>(offset) + 22 + std::max<int16_t>(definitions.Get<int16_t>(offset + 20), 0) * 10 > definitions.size
+					|| definitions.Get<int16_t>(offset + 12) < 0 || definitions.Get<int16_t>(offset + 14) < 0) {
+				std::cerr << "[WARN]: Skipping malformed texture " << j << " in " << textureLump << std::endl;
+				continue;
 			}
-			break;
+			textureDefinitions.Insert(NameKey(definitions.GetString(offset, 8)), definitions.data + offset);
 		}
-		default:
-			break;
+	}
+
+	statistics.directory = SecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	statistics.textureCacheHit = settings::CACHE_TEXTURES && LoadTextureCache();
+	if (settings::CACHE_TEXTURES && !statistics.textureCacheHit) {
+		StoreTextureCache(std::thread::hardware_concurrency());
+		LoadTextureCache();
+	}
+	statistics.textureCache = SecondsSince(start);
+	if (settings::PRELOAD_TEXTURES)
+		Preload(std::thread::hardware_concurrency());
+}
+
+std::shared_ptr<Texture> WAD::LoadFlat(const Lump& lump) const {
+	auto t = std::make_shared<Texture>(lump.name, 64, 64);
+	std::memcpy(t->storage.get(), GetLumpData(lump).data, std::min<size_t>(lump.size, 64 * 64));
+	return t;
+}
+
+// Returns null for a patch whose columns or posts run past the end of its lump
+std::shared_ptr<Texture> WAD::DecodePatch(const Lump& lump) const {
+	const auto patch = GetLumpData(lump);
+	const auto malformed = [&] {
+		std::cerr << "[WARN]: Patch '" << lump.name << "' is malformed" << std::endl;
+		return std::shared_ptr<Texture> {};
+	};
+	if (patch.size < 8)
+		return malformed();
+	const auto width = patch.Get<int16_t>(0);
+	const auto height = patch.Get<int16_t>(2);
+	if (width < 0 || height < 0 || 8 + static_cast<size_t>(width) * 4 > patch.size)
+		return malformed();
+
+	// The left and top offsets are not used for wall textures
+	auto p = std::make_shared<Texture>(lump.name, width, height);
+	for (auto i = 0; i < p->width; i++) {
+		size_t post = patch.Get<uint32_t>(8 + i * 4);
+		while (true) {
+			if (post >= patch.size)
+				return malformed();
+			if (patch.data[post] == 255)
+				break;
+			// Start row, pixel count, padding, the pixels, then more padding
+			if (post + 4 > patch.size || post + 4 + patch.data[post + 1] > patch.size)
+				return malformed();
+			const auto rowStart = patch.data[post];
+			const auto pixelCount = patch.data[post + 1];
+			for (auto j = 0; j < pixelCount && rowStart + j < p->height; j++)
+				p->storage[(j + rowStart) * p->width + i] = patch.data[post + 3 + j];
+			post += pixelCount + 4;
 		}
 	}
+	return p;
+}
 
-	for (const auto& lump : lumps) {
-		switch (lump->type) {
-		case Lump::Type::Texture: {
-			seek(lump->location);
-
-			auto textureCount = read<uint32_t>();
-			std::vector<int32_t> textureOffsets(textureCount);
-			read(textureOffsets.data(), textureOffsets.size());
-
-			for (unsigned i = 0; i < textureCount; i++) {
-				seek(lump->location + textureOffsets[i]);
-
-				auto name = readString(8);
-				read<uint32_t>(); // masked
-				auto width = read<int16_t>();
-				auto height = read<int16_t>();
-				read<uint32_t>(); // column directory
-				auto patchCount = read<int16_t>();
-
-				auto t = std::make_shared<Texture>(name, width, height);
-				for (auto j = 0; j < patchCount; j++) {
-					auto px = read<int16_t>();
-					auto py = read<int16_t>();
-					auto patchNumber = read<uint16_t>();
-					read<int16_t>(); // step direction
-					read<int16_t>(); // color map
-
-					if (patchNumber >= patchNames.size())
-						continue;
-					auto patchIndex = patchNames[patchNumber];
-					if (patches.find(patchIndex) == patches.end())
-						continue;
-					auto patch = patches[patchIndex].get();
-
-					for (auto x = 0; x < patch->width; x++) {
-						for (auto y = 0; y < patch->height; y++) {
-							const auto pixel = patch->pixels[y * patch->width + x];
-							if (pixel == 247)
-								continue;
-							const auto dx = px + x;
-							const auto dy = py + y;
-							if (dx < 0 || dx >= t->width || dy < 0 || dy >= t->height)
-								continue;
-							t->pixels[dy * t->width + dx] = pixel;
-						}
-					}
-				}
-
-				textures.insert(make_pair(name, t));
+std::shared_ptr<Texture> WAD::ComposeTexture(const uint8_t* definition, const std::function<std::shared_ptr<Texture>(uint64_t)>& getPatch) const {
+	const auto d = LumpData { definition, 0 };
+
+	// The masked flag and column directory are not used
+	auto name = d.GetString(0, 8);
+	auto width = d.Get<int16_t>(12);
+	auto height = d.Get<int16_t>(14);
+	auto patchCount = d.Get<int16_t>(20);
+
+	auto t = std::make_shared<Texture>(name, width, height);
+	for (auto j = 0; j < patchCount; j++) {
+		// Each patch also has unused step direction and color map fields
+		const auto patchOffset = 22 + j * 10;
+		auto px = d.Get<int16_t>(patchOffset);
+		auto py = d.Get<int16_t>(patchOffset + 2);
+		auto patchNumber = d.Get<uint16_t>(patchOffset + 4);
+
+		if (patchNumber >= patchNames.size())
+			continue;
+		auto patch = getPatch(patchNames[patchNumber]);
+		if (patch == nullptr)
+			continue;
+
+		for (auto x = 0; x < patch->width; x++) {
+			for (auto y = 0; y < patch->height; y++) {
+				const auto pixel = patch->pixels[y * patch->width + x];
+				if (pixel == 247)
+					continue;
+				const auto dx = px + x;
+				const auto dy = py + y;
+				if (dx < 0 || dx >= t->width || dy < 0 || dy >= t->height)
+					continue;
+				t->storage[dy * t->width + dx] = pixel;
 			}
-			break;
 		}
-		default:
-			break;
+	}
+	return t;
+}
+
+/*
+ * Decodes every patch, then composes every texture, each step spread over a
+ * pool of threads. Textures only read their own patches, so the result is
+ * the same as composing them one by one on demand.
+ *
+ * Only as many textures as fit in TEXTURE_CACHE_SIZE are kept; inserting
+ * more would only evict the earlier ones once nothing pins them.
+ */
+void WAD::Preload(unsigned threads) {
+	size_t skipped = 0;
+	for (const auto& texture : ComposeAll(threads)) {
+		if (cachedTextures.Find(texture.first) != nullptr)
+			continue;
+		if (cache.GetSize() + TextureCache::SizeOf(*texture.second) > cache.GetLimit()) {
+			skipped++;
+			continue;
 		}
+		cache.Get(TextureCache::Kind::Texture, texture.first, [&] { return texture.second; });
 	}
+	if (skipped > 0)
+		std::cerr << "[WARN]: Preloading skipped " << skipped << " textures that did not fit in the texture cache" << std::endl;
+}
+
+std::vector<std::pair<uint64_t, std::shared_ptr<Texture>>> WAD::ComposeAll(unsigned threads) const {
+	std::vector<std::pair<uint64_t, size_t>> patchList;
+	patchLumps.ForEach([&](uint64_t key, size_t index) { patchList.emplace_back(key, index); });
+	std::vector<std::pair<uint64_t, const uint8_t*>> textureList;
+	textureDefinitions.ForEach([&](uint64_t key, const uint8_t* definition) { textureList.emplace_back(key, definition); });
+
+	auto start = std::chrono::steady_clock::now();
+	NameTable<std::shared_ptr<Texture>> patches;
+	std::vector<std::shared_ptr<Texture>> decoded(patchList.size());
+	ParallelFor(patchList.size(), threads, [&](size_t i) {
+		decoded[i] = DecodePatch(*lumps[patchList[i].second]);
+	});
+	for (size_t i = 0; i < patchList.size(); i++)
+		patches.Insert(patchList[i].first, decoded[i]);
+	statistics.patches = SecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	std::vector<std::shared_ptr<Texture>> composed(textureList.size());
+	ParallelFor(textureList.size(), threads, [&](size_t i) {
+		composed[i] = ComposeTexture(textureList[i].second, [&](uint64_t patch) -> std::shared_ptr<Texture> {
+			auto entry = patches.Find(patch);
+			return entry == nullptr ? nullptr : *entry;
+		});
+	});
+	statistics.textures = SecondsSince(start);
+	std::vector<std::pair<uint64_t, std::shared_ptr<Texture>>> textures;
+	for (size_t i = 0; i < textureList.size(); i++)
+		textures.emplace_back(textureList[i].first, composed[i]);
+	return textures;
+}
+
+std::shared_ptr<Texture> WAD::GetPatch(uint64_t key) const {
+	return cache.Get(TextureCache::Kind::Patch, key, [&]() -> std::shared_ptr<Texture> {
+		auto index = patchLumps.Find(key);
+		return index == nullptr ? nullptr : DecodePatch(*lumps[*index]);
+	});
 }
 
 WAD::~WAD() {
-	if (file.is_open())
-		file.close();
+	for (const auto& file : files)
+		munmap(const_cast<uint8_t*>(file.data), file.size);
+	if (cacheFile.data != nullptr)
+		munmap(const_cast<uint8_t*>(cacheFile.data), cacheFile.size);
 }
 
-std::shared_ptr<WAD::Lump> WAD::GetLump(const std::string& name) {
-	for (auto it = lumps.begin(); it != lumps.end(); it++) {
-		if ((*it)->name == name) {
-			return *it;
+// Maps a WAD file and appends its directory to the merged one, without copying lump data
+void WAD::AddFile(const std::string& filename, const std::string& expectedType) {
+	const auto fd = open(filename.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		std::cerr << "Error: could not open WAD '" << filename << "'" << std::endl;
+		exit(1);
+	}
+	const auto size = static_cast<size_t>(st.st_size);
+	const auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED || size < 12) {
+		std::cerr << "Error: could not map WAD '" << filename << "'" << std::endl;
+		exit(1);
+	}
+	const auto file = LumpData { static_cast<const uint8_t*>(mapping), size };
+	files.push_back(file);
+	contentHash = HashWords(contentHash, file.data, size);
+
+	auto type = file.GetString(0, 4);
+	if (type != expectedType) {
+		std::cerr << "Error: unsupported WAD type '" << type << "' in '" << filename << "'" << std::endl;
+		exit(1);
+	}
+	auto lumpCount = file.Get<uint32_t>(4);
+	auto directoryLocation = file.Get<uint32_t>(8);
+	if (static_cast<size_t>(directoryLocation) + lumpCount * 16ul > size) {
+		std::cerr << "Error: truncated WAD directory in '" << filename << "'" << std::endl;
+		exit(1);
+	}
+	hash = Fnv1a(hash, &lumpCount, sizeof(lumpCount));
+	for (uint32_t i = 0; i < lumpCount; i++) {
+		const auto entry = directoryLocation + i * 16;
+		auto location = file.Get<uint32_t>(entry);
+		auto lumpSize = file.Get<uint32_t>(entry + 4);
+		auto name = file.GetString(entry + 8, 8);
+		if (static_cast<size_t>(location) + lumpSize > size) {
+			std::cerr << "Error: lump '" << name << "' lies outside '" << filename << "'" << std::endl;
+			exit(1);
 		}
+		lumpIndices.Insert(NameKey(name), lumps.size(), true);
+		lumps.push_back(std::make_shared<Lump>(files.size() - 1, file.data + location, location, lumpSize, name));
+		hash = Fnv1a(hash, &location, sizeof(location));
+		hash = Fnv1a(hash, &lumpSize, sizeof(lumpSize));
+		hash = Fnv1a(hash, name.data(), name.size());
 	}
+}
+
+std::shared_ptr<WAD::Lump> WAD::GetLump(const std::string& name) {
+	if (auto index = lumpIndices.Find(NameKey(name)))
+		return lumps[*index];
 	std::cerr << "[WARN]: Could not find lump '" << name << '\'' << std::endl;
 	return nullptr;
 }
 
+static bool IsMapLump(const std::string& name) {
+	static const char* const names[] = {
+		"THINGS", "LINEDEFS", "SIDEDEFS", "VERTEXES", "SEGS",
+		"SSECTORS", "NODES", "SECTORS", "REJECT", "BLOCKMAP",
+	};
+	for (const auto mapLump : names) {
+		if (name == mapLump)
+			return true;
+	}
+	return false;
+}
+
 std::map<std::string, std::shared_ptr<WAD::Lump>> WAD::GetMapLumps(const std::string& name) {
 	std::map<std::string, std::shared_ptr<Lump>> mapLumps;
-	for (auto it = lumps.begin(); it != lumps.end(); it++) {
-		if ((*it)->type == Lump::Type::MapMarker && (*it)->name == name) {
-			for (auto i = 0; i < 10; i++, it++) {
-				mapLumps.insert(make_pair((*it)->name, *it));
-			}
-			break;
-		}
-	}
+	auto index = lumpIndices.Find(NameKey(name));
+	if (index == nullptr || lumps[*index]->type != Lump::Type::MapMarker)
+		return mapLumps;
+	// Stop at the first non-map lump, since node lumps may be absent
+	auto it = lumps.begin() + *index;
+	mapLumps.insert(make_pair((*it)->name, *it));
+	while (++it != lumps.end() && IsMapLump((*it)->name))
+		mapLumps.insert(make_pair((*it)->name, *it));
 	return mapLumps;
 }
 
+// Every map marker, in directory order, skipping those overridden by a later file
+std::vector<std::string> WAD::GetMapNames() const {
+	std::vector<std::string> names;
+	for (size_t i = 0; i < lumps.size(); i++) {
+		if (lumps[i]->type != Lump::Type::MapMarker)
+			continue;
+		auto index = lumpIndices.Find(NameKey(lumps[i]->name));
+		if (index != nullptr && *index == i)
+			names.push_back(lumps[i]->name);
+	}
+	return names;
+}
+
 std::shared_ptr<Texture> WAD::GetFlat(const std::string& name) const {
 	if (name == "-")
 		return nullptr;
-	std::string upper(name);
-	std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
-	const auto& flat = flats.find(upper);
-	if (flat != flats.end())
-		return flat->second;
+	const auto key = NameKey(name);
+	// Flats in the mapped cache file live in the page cache, so they bypass
+	// the LRU rather than take up its budget
+	if (auto cached = GetCachedTexture(cachedFlats, key))
+		return cached;
+	auto flat = cache.Get(TextureCache::Kind::Flat, key, [&]() -> std::shared_ptr<Texture> {
+		auto index = flatLumps.Find(key);
+		return index == nullptr ? nullptr : LoadFlat(*lumps[*index]);
+	});
+	if (flat != nullptr)
+		return flat;
 	std::cerr << "[WARN]: Could not find flat '" << name << "'" << std::endl;
 	return nullptr;
 }
@@ -223,11 +416,15 @@ std::shared_ptr<Texture> WAD::GetFlat(const std::string& name) const {
 std::shared_ptr<Texture> WAD::GetTexture(const std::string& name) const {
 	if (name == "-")
 		return nullptr;
-	std::string upper(name);
-	std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
-	const auto& texture = textures.find(upper);
-	if (texture != textures.end())
-		return texture->second;
+	const auto key = NameKey(name);
+	if (auto cached = GetCachedTexture(cachedTextures, key))
+		return cached;
+	auto texture = cache.Get(TextureCache::Kind::Texture, key, [&]() -> std::shared_ptr<Texture> {
+		auto definition = textureDefinitions.Find(key);
+		return definition == nullptr ? nullptr : ComposeTexture(*definition, [this](uint64_t patch) { return GetPatch(patch); });
+	});
+	if (texture != nullptr)
+		return texture;
 	std::cerr << "[WARN]: Could not find texture '" << name << "'" << std::endl;
 	return nullptr;
 }
\ No newline at end of file
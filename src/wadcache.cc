@@ -0,0 +1,158 @@
+#include "wad.h"
+
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "settings.h"
+
+/*
+ * On-disk layout
+ *
+ * A header, then one index entry per texture followed by one per flat, then
+ * the pixel blocks the entries point at. Textures are served straight from
+ * the mapping, so the file is only paged in for the textures a level uses.
+ */
+namespace {
+	constexpr char MAGIC[4] = { 'D', 'T', 'E', 'X' };
+	constexpr uint32_t VERSION = 1;
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint64_t contentHash;
+		uint32_t textureCount;
+		uint32_t flatCount;
+	};
+
+	// One file per WAD stack, so switching between them keeps each cache
+	std::string CachePath(uint64_t contentHash) {
+		std::ostringstream path;
+		path << settings::CACHE_DIRECTORY << "/textures-" << std::hex << std::setw(16) << std::setfill('0') << contentHash << ".cache";
+		return path.str();
+	}
+}
+
+struct WAD::CachedTexture {
+	char name[8];
+	int32_t width;
+	int32_t height;
+	uint64_t offset;
+};
+
+bool WAD::LoadTextureCache() {
+	const auto path = CachePath(contentHash);
+	const auto fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+		close(fd);
+		return false;
+	}
+	const auto size = static_cast<size_t>(st.st_size);
+	const auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED)
+		return false;
+
+	const auto file = LumpData { static_cast<const uint8_t*>(mapping), size };
+	const auto header = file.Get<Header>(0);
+	const auto entryCount = static_cast<size_t>(header.textureCount) + header.flatCount;
+	if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION
+			|| header.contentHash != contentHash || sizeof(Header) + entryCount * sizeof(CachedTexture) > size) {
+		munmap(mapping, size);
+		return false;
+	}
+	const auto entries = reinterpret_cast<const CachedTexture*>(file.data + sizeof(Header));
+	for (size_t i = 0; i < entryCount; i++) {
+		if (entries[i].offset + static_cast<size_t>(entries[i].width) * entries[i].height > size) {
+			munmap(mapping, size);
+			return false;
+		}
+	}
+
+	if (cacheFile.data != nullptr)
+		munmap(const_cast<uint8_t*>(cacheFile.data), cacheFile.size);
+	cacheFile = file;
+	for (size_t i = 0; i < entryCount; i++) {
+		const auto& entry = entries[i];
+		auto& texture = cachedArena.emplace_back(std::string(entry.name, strnlen(entry.name, sizeof(entry.name))), entry.width, entry.height, file.data + entry.offset);
+		(i < header.textureCount ? cachedTextures : cachedFlats).Insert(NameKey(entry.name), &texture);
+	}
+	return true;
+}
+
+void WAD::StoreTextureCache(unsigned threads) const {
+	auto textures = ComposeAll(threads);
+	std::vector<std::shared_ptr<Texture>> flats;
+	flatLumps.ForEach([&](uint64_t, size_t index) { flats.push_back(LoadFlat(*lumps[index])); });
+
+	Header header {};
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.contentHash = contentHash;
+	header.textureCount = textures.size();
+	header.flatCount = flats.size();
+
+	std::vector<CachedTexture> entries;
+	auto offset = sizeof(Header) + (textures.size() + flats.size()) * sizeof(CachedTexture);
+	const auto addEntry = [&](const Texture& texture) {
+		CachedTexture entry {};
+		std::strncpy(entry.name, texture.name.c_str(), sizeof(entry.name));
+		entry.width = texture.width;
+		entry.height = texture.height;
+		entry.offset = offset;
+		entries.push_back(entry);
+		offset += static_cast<size_t>(texture.width) * texture.height;
+	};
+	for (const auto& texture : textures)
+		addEntry(*texture.second);
+	for (const auto& flat : flats)
+		addEntry(*flat);
+
+	// Write next to the final path and rename, so readers never see a partial
+	// file; the temporary name is unique, so concurrent rebuilds cannot mix
+	mkdir(settings::CACHE_DIRECTORY, 0755);
+	const auto path = CachePath(contentHash);
+	auto temporaryPath = path + ".XXXXXX";
+	const auto fd = mkstemp(temporaryPath.data());
+	if (fd < 0) {
+		std::cerr << "[WARN]: Could not write texture cache '" << path << "'" << std::endl;
+		return;
+	}
+	fchmod(fd, 0644);
+	close(fd);
+	std::ofstream file(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cerr << "[WARN]: Could not write texture cache '" << path << "'" << std::endl;
+		std::remove(temporaryPath.c_str());
+		return;
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(CachedTexture));
+	for (const auto& texture : textures)
+		file.write(reinterpret_cast<const char*>(texture.second->pixels), static_cast<size_t>(texture.second->width) * texture.second->height);
+	for (const auto& flat : flats)
+		file.write(reinterpret_cast<const char*>(flat->pixels), static_cast<size_t>(flat->width) * flat->height);
+	file.close();
+	if (!file || std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+		std::cerr << "[WARN]: Could not write texture cache '" << path << "'" << std::endl;
+		std::remove(temporaryPath.c_str());
+	}
+}
+
+std::shared_ptr<Texture> WAD::GetCachedTexture(const NameTable<Texture*>& table, uint64_t key) const {
+	auto entry = table.Find(key);
+	if (entry == nullptr)
+		return nullptr;
+	// Entries live in the arena for the lifetime of the WAD, so hand out
+	// non-owning references; callers keep these out of the LRU, whose pin
+	// check cannot see them
+	return std::shared_ptr<Texture>(std::shared_ptr<Texture> {}, *entry);
+}
\ No newline at end of file